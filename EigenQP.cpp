@@ -36,6 +36,9 @@
 #include <stdexcept>
 #include "EigenQP.h"
 #include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 //#define TRACE_SOLVER
 //#include <boost/numeric/ublas/vector.hpp>
 //#include <boost/numeric/ublas/matrix.hpp>
@@ -47,46 +50,388 @@ using std::vector;
 namespace QP {
   
 // Utility functions for updating some data needed by the solution method 
-void compute_d(VectorXd& d, const MatrixXd& J, const VectorXd& np);
-void update_z(VectorXd& z, const MatrixXd& J, const VectorXd& d, int iq);
-void update_r(const MatrixXd& R, VectorXd& r, const VectorXd& d, int iq);
-bool add_constraint(MatrixXd& R, MatrixXd& J, VectorXd& d, int& iq, double& rnorm);
-void delete_constraint(MatrixXd& R, MatrixXd& J, VectorXi& A, VectorXd& u, int n, int p, int& iq, int l);
+template<typename Scalar>
+void compute_d(Matrix<Scalar, Dynamic, 1>& d, const Matrix<Scalar, Dynamic, Dynamic>& J, 
+               const Matrix<Scalar, Dynamic, 1>& np);
+template<typename Scalar, typename Derived>
+void compute_d(Matrix<Scalar, Dynamic, 1>& d, const Matrix<Scalar, Dynamic, Dynamic>& J, 
+               const Matrix<Scalar, Dynamic, 1>& np, const MatrixBase<Derived>& C, int i);
+template<typename Scalar>
+void compute_d(Matrix<Scalar, Dynamic, 1>& d, const Matrix<Scalar, Dynamic, Dynamic>& J, 
+               const Matrix<Scalar, Dynamic, 1>& np, const SparseMatrix<Scalar>& C, int i);
+template<typename Scalar>
+void update_z(Matrix<Scalar, Dynamic, 1>& z, const Matrix<Scalar, Dynamic, Dynamic>& J, 
+              const Matrix<Scalar, Dynamic, 1>& d, int iq);
+template<typename Scalar>
+void update_r(const Matrix<Scalar, Dynamic, Dynamic>& R, Matrix<Scalar, Dynamic, 1>& r, 
+              const Matrix<Scalar, Dynamic, 1>& d, int iq);
+template<typename Scalar>
+bool add_constraint(Matrix<Scalar, Dynamic, Dynamic>& R, Matrix<Scalar, Dynamic, Dynamic>& J, 
+                    Matrix<Scalar, Dynamic, 1>& d, int& iq, Scalar& rnorm);
+template<typename Scalar>
+void apply_givens(Scalar* x, Scalar* y, int n, Scalar cc, Scalar ss, Scalar xny);
+template<typename Scalar>
+void delete_constraint(Matrix<Scalar, Dynamic, Dynamic>& R, Matrix<Scalar, Dynamic, Dynamic>& J, 
+                       VectorXi& A, Matrix<Scalar, Dynamic, 1>& u, int n, int p, int& iq, int l);
 
 // Utility functions for computing the Cholesky decomposition and solving
 // linear systems
-void cholesky_decomposition(MatrixXd& A);
-void cholesky_solve(const MatrixXd& L, VectorXd& x, const VectorXd& b);
-void forward_elimination(const MatrixXd& L, VectorXd& y, const VectorXd& b);
-void backward_elimination(const MatrixXd& U, VectorXd& x, const VectorXd& y);
+template<typename Scalar>
+void cholesky_decomposition(Matrix<Scalar, Dynamic, Dynamic>& A);
+template<typename Scalar>
+void inverse_cholesky_factor(const Matrix<Scalar, Dynamic, Dynamic>& L, Matrix<Scalar, Dynamic, 
+                             Dynamic>& J);
+template<typename Scalar>
+void cholesky_solve(const Matrix<Scalar, Dynamic, Dynamic>& L, Matrix<Scalar, Dynamic, 1>& x, 
+                    const Matrix<Scalar, Dynamic, 1>& b);
+template<typename Derived>
+bool is_diagonal(const MatrixBase<Derived>& G);
+template<typename Scalar>
+void forward_elimination(const Matrix<Scalar, Dynamic, Dynamic>& L, Matrix<Scalar, Dynamic, 1>& y, 
+                         const Matrix<Scalar, Dynamic, 1>& b);
+template<typename Scalar>
+void backward_elimination(const Matrix<Scalar, Dynamic, Dynamic>& U, Matrix<Scalar, Dynamic, 1>& x, 
+                          const Matrix<Scalar, Dynamic, 1>& y);
 
 // Utility functions for computing the scalar product and the euclidean 
 // distance between two numbers
-double scalar_product(const VectorXd& x, const VectorXd& y);
-double distance(double a, double b);
+template<typename Scalar>
+Scalar scalar_product(const Matrix<Scalar, Dynamic, 1>& x, const Matrix<Scalar, Dynamic, 1>& y);
+template<typename Scalar>
+Scalar distance(Scalar a, Scalar b);
+
+/* Slack factor of the stopping test on the total infeasibility psi, which is
+   m * eps * cond(G) * margin. Single precision cannot afford the factor of
+   100 used for double: it would accept violations of a few percent. */
+template<typename Scalar>
+inline Scalar infeasibility_margin()
+{
+  return Scalar(100);
+}
+
+template<>
+inline float infeasibility_margin<float>()
+{
+  return 1.0f;
+}
 
 // Utility functions for printing ublas::vectors and matrices
-void print_matrix(const char* name, const MatrixXd& A, int n = -1, int m = -1);
+template<typename Scalar>
+void print_matrix(const char* name, const Matrix<Scalar, Dynamic, Dynamic>& A, int n = -1, int m = -1);
 
   //template<typename T>
 //void print_vector(const char* name, const ublas::vector<T>& v, int n = -1);
 
 // The Solving function, implementing the Goldfarb-Idnani method
 
-double solve_quadprog(MatrixXd& G, VectorXd& g0, 
-                      const MatrixXd& CE, const VectorXd& ce0,  
-                      const MatrixXd& CI, const VectorXd& ci0, 
+double solve_quadprog(const Ref<const MatrixXd>& G, const Ref<const VectorXd>& g0, 
+                      const Ref<const MatrixXd>& CE, const Ref<const VectorXd>& ce0,  
+                      const Ref<const MatrixXd>& CI, const Ref<const VectorXd>& ci0, 
+                      VectorXd& x)
+{
+  Solver solver;
+  return solver.solve(G, g0, CE, ce0, CI, ci0, x);
+}
+
+double solve_quadprog(const Ref<const MatrixXd>& G, const Ref<const VectorXd>& g0, 
+                      const SparseMatrix<double>& CE, const Ref<const VectorXd>& ce0,  
+                      const SparseMatrix<double>& CI, const Ref<const VectorXd>& ci0, 
+                      VectorXd& x)
+{
+  Solver solver;
+  return solver.solve(G, g0, CE, ce0, CI, ci0, x);
+}
+
+double solve_quadprog(const Ref<const MatrixXd>& G, const Ref<const VectorXd>& g0, 
+                      const Ref<const MatrixXd>& CE, const Ref<const VectorXd>& ce0,  
+                      const Ref<const MatrixXd>& CI, const Ref<const VectorXd>& ci0, 
+                      const Ref<const VectorXd>& lb, const Ref<const VectorXd>& ub, 
+                      VectorXd& x)
+{
+  Solver solver;
+  solver.set_bounds(lb, ub);
+  return solver.solve(G, g0, CE, ce0, CI, ci0, x);
+}
+
+double solve_quadprog(const Ref<const MatrixXd>& G, const Ref<const VectorXd>& g0, 
+                      const Ref<const MatrixXd>& CE, const Ref<const VectorXd>& ce0,  
+                      const Ref<const MatrixXd>& CI, const Ref<const VectorXd>& cl, const Ref<const VectorXd>& cu, 
                       VectorXd& x)
 {
-  std::ostringstream msg;
+  Solver solver;
+  return solver.solve_ranged(G, g0, CE, ce0, CI, cl, cu, x);
+}
+
+void solve_quadprog_batch(const MatrixXd& G, const MatrixXd& g0, 
+                          const MatrixXd& CE, const MatrixXd& ce0,  
+                          const MatrixXd& CI, const MatrixXd& ci0, 
+                          MatrixXd& x, VectorXd& f_value, VectorXi& status,
+                          int num_threads)
+{
+  solve_quadprog_batch(vector<MatrixXd>(1, G), g0, vector<MatrixXd>(1, CE), ce0, 
+                       vector<MatrixXd>(1, CI), ci0, x, f_value, status, num_threads);
+}
+
+void solve_quadprog_batch(const vector<MatrixXd>& G, const MatrixXd& g0, 
+                          const vector<MatrixXd>& CE, const MatrixXd& ce0,  
+                          const vector<MatrixXd>& CI, const MatrixXd& ci0, 
+                          MatrixXd& x, VectorXd& f_value, VectorXi& status,
+                          int num_threads)
+{
+  int N = g0.cols();
+  if (G.empty() || CE.empty() || CI.empty() ||
+      ((int)G.size() != 1 && (int)G.size() != N) ||
+      ((int)CE.size() != 1 && (int)CE.size() != N) ||
+      ((int)CI.size() != 1 && (int)CI.size() != N))
+  {
+    std::ostringstream msg;
+    msg << "G, CE and CI must hold either one matrix or one matrix per problem (" 
+        << N << " problems)";
+    throw std::logic_error(msg.str());
+  }
+  if (ce0.cols() != N || ci0.cols() != N)
+  {
+    std::ostringstream msg;
+    msg << "ce0 and ci0 must have one column per problem (" << N << " problems)";
+    throw std::logic_error(msg.str());
+  }
+  int n = g0.rows();
+  x.resize(n, N);
+  f_value.resize(N);
+  status.resize(N);
+  
+  /* a shared G is factorized once, and the factor copied into each thread's
+     solver */
+  Solver shared;
+  if (G.size() == 1)
+  {
+    try
+    {
+      shared.factorize(G[0]);
+    }
+    catch (std::exception&)
+    {
+      /* every problem fails, as a per-problem G that fails would */
+      f_value.setConstant(std::numeric_limits<double>::quiet_NaN());
+      status.setConstant(FAILED);
+      x.setConstant(std::numeric_limits<double>::quiet_NaN());
+      return;
+    }
+  }
+  
+#ifdef _OPENMP
+  if (num_threads <= 0)
+    num_threads = omp_get_max_threads();
+#pragma omp parallel num_threads(num_threads)
+#endif
+  {
+    Solver solver(shared);
+    VectorXd xk, g0k, ce0k, ci0k;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+    for (int k = 0; k < N; k++)
+    {
+      const MatrixXd& CEk = CE.size() == 1 ? CE[0] : CE[k];
+      const MatrixXd& CIk = CI.size() == 1 ? CI[0] : CI[k];
+      g0k = g0.col(k);
+      ce0k = ce0.col(k);
+      ci0k = ci0.col(k);
+      try
+      {
+        if (G.size() != 1)
+          solver.factorize(G[k]);
+        f_value(k) = solver.solve_factored(g0k, CEk, ce0k, CIk, ci0k, xk);
+        status(k) = f_value(k) == std::numeric_limits<double>::infinity() ? INFEASIBLE : SOLVED;
+        x.col(k) = xk;
+      }
+      catch (std::exception&)
+      {
+        /* exceptions must not escape the parallel region */
+        f_value(k) = std::numeric_limits<double>::quiet_NaN();
+        status(k) = FAILED;
+        x.col(k).setConstant(std::numeric_limits<double>::quiet_NaN());
+      }
+    }
+  }
+}
+
+/* the active set passed, and not read, by the solves without a warm start */
+static const VectorXi no_active;
+
+template<typename Scalar>
+BasicSolver<Scalar>::BasicSolver()
+  : n(0), p(0), m(0), iq(0), iter(0), factorized(false), diagonal(false), x_given(false), resume(false), direct(false), nullspace(false)
+{ }
+
+template<typename Scalar>
+BasicSolver<Scalar>::BasicSolver(int n, int p, int m)
+  : n(0), p(0), m(0), iq(0), iter(0), factorized(false), diagonal(false), x_given(false), resume(false), direct(false), nullspace(false)
+{
+  resize(n, p, m);
+}
+
+template<typename Scalar>
+void BasicSolver<Scalar>::resize(int n, int p, int m)
+{
+  this->n = n;
+  this->p = p;
+  this->m = m;
+  L.resize(n, n);
+  J0.resize(n, n);
+  R.resize(n, n);
+  J.resize(n, n);
+  z.resize(n);
+  d.resize(n);
+  np.resize(n);
+  x_old.resize(n);
+  s.resize(m + p);
+  r.resize(m + p);
+  /* one extra slot for the constraint being added to (or dropped from) a
+     full active set */
+  u.resize(m + p + 1);
+  u_old.resize(m + p);
+  A.resize(m + p + 1);
+  A_old.resize(m + p);
+  iai.resize(m + p);
+  iaexcl.resize(m + p);
+  W.resize(n, p);
+  W_h.resize(p);
+  W_work.resize(n);
+  lower.resize(m);
+  upper.resize(m);
+  side.resize(m);
+}
+
+template<typename Scalar>
+void BasicSolver<Scalar>::insert_rows(int mci, int k)
+{
+  int i;
+
+  m += k;
+  s.resize(m + p);
+  r.resize(m + p);
+  u.conservativeResize(m + p + 1);
+  u_old.resize(m + p);
+  A.conservativeResize(m + p + 1);
+  A_old.resize(m + p);
+  iai.resize(m + p);
+  iaexcl.resize(m + p);
+  lower.resize(m);
+  upper.resize(m);
+  /* the rows after the first mci (the bounds) move up by k */
+  side.conservativeResize(m);
+  for (i = m - 1; i >= mci + k; i--)
+    side(i) = side(i - k);
+  for (i = p; i < iq; i++)
+    if (A(i) >= mci)
+      A(i) += k;
+}
+
+template<typename Scalar>
+void BasicSolver<Scalar>::set_bounds(const VectorRef& lb, const VectorRef& ub)
+{
+  if (lb.size() != ub.size())
+  {
+    std::ostringstream msg;
+    msg << "The bounds lb and ub have different dimensions (" 
+        << lb.size() << " and " << ub.size() << ")";
+    throw std::logic_error(msg.str());
+  }
+  this->lb = lb;
+  this->ub = ub;
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve(const MatrixRef& G, const VectorRef& g0, 
+                                  const MatrixRef& CE, const VectorRef& ce0,  
+                                  const MatrixRef& CI, const VectorRef& ci0, 
+                                  VectorX& x)
+{
+  factorize(G);
+  return solve_factored(g0, CE, ce0, CI, ci0, x);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve(const MatrixRef& G, const VectorRef& g0, 
+                                  const MatrixRef& CE, const VectorRef& ce0,  
+                                  const MatrixRef& CI, const VectorRef& ci0, 
+                                  VectorX& x, const VectorXi& active)
+{
+  factorize(G);
+  return solve_factored(g0, CE, ce0, CI, ci0, x, active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve(const MatrixRef& G, const VectorRef& g0, 
+                                  const SparseMatrixX& CE, const VectorRef& ce0,  
+                                  const SparseMatrixX& CI, const VectorRef& ci0, 
+                                  VectorX& x)
+{
+  factorize(G);
+  return solve_factored(g0, CE, ce0, CI, ci0, x);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve(const MatrixRef& G, const VectorRef& g0, 
+                                  const SparseMatrixX& CE, const VectorRef& ce0,  
+                                  const SparseMatrixX& CI, const VectorRef& ci0, 
+                                  VectorX& x, const VectorXi& active)
+{
+  factorize(G);
+  return solve_factored(g0, CE, ce0, CI, ci0, x, active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_ranged(const MatrixRef& G, const VectorRef& g0, 
+                                         const MatrixRef& CE, const VectorRef& ce0,  
+                                         const MatrixRef& CI, const VectorRef& cl, const VectorRef& cu, 
+                                         VectorX& x)
+{
+  factorize(G);
+  return solve_factored_ranged(g0, CE, ce0, CI, cl, cu, x);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_ranged(const MatrixRef& G, const VectorRef& g0, 
+                                         const MatrixRef& CE, const VectorRef& ce0,  
+                                         const MatrixRef& CI, const VectorRef& cl, const VectorRef& cu, 
+                                         VectorX& x, const VectorXi& active)
+{
+  factorize(G);
+  return solve_factored_ranged(g0, CE, ce0, CI, cl, cu, x, active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_ranged(const MatrixRef& G, const VectorRef& g0, 
+                                         const SparseMatrixX& CE, const VectorRef& ce0,  
+                                         const SparseMatrixX& CI, const VectorRef& cl, const VectorRef& cu, 
+                                         VectorX& x)
+{
+  factorize(G);
+  return solve_factored_ranged(g0, CE, ce0, CI, cl, cu, x);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_ranged(const MatrixRef& G, const VectorRef& g0, 
+                                         const SparseMatrixX& CE, const VectorRef& ce0,  
+                                         const SparseMatrixX& CI, const VectorRef& cl, const VectorRef& cu, 
+                                         VectorX& x, const VectorXi& active)
+{
+  factorize(G);
+  return solve_factored_ranged(g0, CE, ce0, CI, cl, cu, x, active);
+}
+
+template<typename Scalar>
+void BasicSolver<Scalar>::factorize(const MatrixRef& G)
+{
+  int i;
   {
     //Ensure that the dimensions of the matrices and ublas::vectors can be
     //safely converted from unsigned int into to int without overflow.
     unsigned mx = std::numeric_limits<int>::max();
-    if(G.cols() >= mx || G.rows() >= mx || 
-       CE.rows() >= mx || CE.cols() >= mx ||
-       CI.rows() >= mx || CI.cols() >= mx || 
-       ci0.size() >= mx || ce0.size() >= mx || g0.size() >= mx){
+    if(G.cols() >= mx || G.rows() >= mx){
+      std::ostringstream msg;
       msg << "The dimensions of one of the input matrices or ublas::vectors were "
 	  << "too large." << std::endl
 	  << "The maximum allowable size for inputs to solve_quadprog is:"
@@ -94,82 +439,690 @@ double solve_quadprog(MatrixXd& G, VectorXd& g0,
       throw std::logic_error(msg.str());
     }
   }
-  int n = G.cols(), p = CE.cols(), m = CI.cols();
-  if ((int)G.rows() != n)
+  if (G.rows() != G.cols())
   {
+    std::ostringstream msg;
     msg << "The ublas::matrix G is not a square ublas::matrix (" << G.rows() << " x " 
 	<< G.cols() << ")";
     throw std::logic_error(msg.str());
   }
+  /* the workspace is only reallocated when the problem dimensions change */
+  if (G.cols() != n)
+    resize(G.cols(), p, m);
+  factorized = false;
+#ifdef TRACE_SOLVER
+  print_matrix("G", G);
+#endif  
+  
+  /*
+   * Preprocessing phase
+   */
+	
+  /* compute the trace of the original ublas::matrix G */
+  c1 = 0.0;
+  for (i = 0; i < n; i++)
+  {
+    c1 += G(i, i);
+  }
+  /* a diagonal G (the identity of a projection, a weighting) has the
+     diagonal factor L = G^1/2, and J0 = L^-T is diagonal as well: neither
+     takes the O(n^3) factorization */
+  diagonal = is_diagonal(G);
+  if (diagonal)
+  {
+    for (i = 0; i < n; i++)
+      if (!(G(i, i) > 0.0))
+      {
+	std::ostringstream os;
+	os << "Error in cholesky decomposition, the matrix is not positive definite "
+	   << "(diagonal element " << i << ")";
+	throw std::logic_error(os.str());
+      }
+    L.setZero();
+    L.diagonal() = G.diagonal().cwiseSqrt();
+    J0.setZero();
+    J0.diagonal() = L.diagonal().cwiseInverse();
+  }
+  else
+  {
+    /* decompose the ublas::matrix G in the form L^T L, on a copy so that the 
+       caller's G is left untouched */
+    L = G;
+    cholesky_decomposition(L);
+#ifdef TRACE_SOLVER
+    print_matrix("L", L);
+#endif
+  
+    /* compute the inverse of the factorized ublas::matrix G^-1, this is the initial value for H */
+    inverse_cholesky_factor(L, J0);
+  }
+  c2 = J0.trace();
+#ifdef TRACE_SOLVER
+  print_matrix("J0", J0);
+#endif
+  factorized = true;
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_nullspace(const MatrixRef& G, const VectorRef& g0, 
+                                            const MatrixRef& CE, const VectorRef& ce0,  
+                                            const MatrixRef& CI, const VectorRef& ci0, 
+                                            VectorX& x)
+{
+  int i;
+  const int nx = G.rows(), pe = CE.cols(), k = nx - pe, mci = CI.cols(), nb = lb.size();
+  const Scalar inf = std::numeric_limits<Scalar>::infinity();
+  if (CE.rows() != nx || ce0.size() != pe || pe > nx)
+  {
+    std::ostringstream msg;
+    msg << "The equality constraints are incompatible (CE is " << CE.rows() << " x " << pe
+	<< " and ce0 has " << ce0.size() << ", expecting " << nx << " rows and at most " 
+	<< nx << " constraints)";
+    throw std::logic_error(msg.str());
+  }
+  if (CI.rows() != nx || ci0.size() != mci || g0.size() != nx || (nb != 0 && nb != nx))
+  {
+    std::ostringstream msg;
+    msg << "The dimensions of the problem are inconsistent: G is " << nx << " x " << G.cols()
+	<< ", g0 has " << g0.size() << " elements, CI is " << CI.rows() << " x " << mci 
+	<< ", ci0 has " << ci0.size() << " and the bounds " << nb;
+    throw std::logic_error(msg.str());
+  }
+
+  /* CE = Q (Re 0)^T = (Y Z) (Re 0)^T, in place in W as in 
+     equality_solution(): x0 = -Y Re^-T ce0, and the columns of Z span the
+     null space of CE^T. Q is only ever applied, one reflector at a time */
+  W = CE;
+  W_h.resize(pe);
+  /* as long as a row of QG or a row of QC; it only grows, as the solves 
+     of this solver's own size use it too */
+  if (W_work.size() < std::max(nx, mci + nb))
+    W_work.resize(std::max(nx, mci + nb));
+  Scalar R_norm = 0.0;
+  for (i = 0; i < pe; i++)
+  {
+    Scalar beta;
+    W.col(i).tail(nx - i).makeHouseholderInPlace(W_h(i), beta);
+    W(i, i) = beta;
+    W.bottomRightCorner(nx - i, pe - i - 1).applyHouseholderOnTheLeft(W.col(i).tail(nx - i - 1), W_h(i), W_work.data());
+    R_norm = std::max<Scalar>(R_norm, std::abs(beta));
+  }
+  for (i = 0; i < pe; i++)
+    if (std::abs(W(i, i)) <= nx * std::numeric_limits<Scalar>::epsilon() * R_norm)
+      // Equality constraints are linearly dependent
+      throw std::runtime_error("Constraints are linearly dependent");
+  x0.resize(nx);
+  x0.head(pe) = -ce0;
+  W.topRows(pe).template triangularView<Upper>().transpose().solveInPlace(x0.head(pe));
+  x0.tail(k).setZero();
+
+  /* Q^T G Q, whose trailing k x k block is Z^T G Z; with x0 = Q (t 0)^T,
+     the gradient Z^T (G x0 + g0) is the tail of Q^T g0 plus the lower left
+     block of Q^T G Q times t */
+  QG = G;
+  for (i = 0; i < pe; i++)
+    QG.rightCols(nx - i).applyHouseholderOnTheRight(W.col(i).tail(nx - i - 1), W_h(i), W_work.data());
+  for (i = 0; i < pe; i++)
+    QG.bottomRows(nx - i).applyHouseholderOnTheLeft(W.col(i).tail(nx - i - 1), W_h(i), W_work.data());
+  gq = g0;
+  for (i = 0; i < pe; i++)
+    gq.tail(nx - i).applyHouseholderOnTheLeft(W.col(i).tail(nx - i - 1), W_h(i), W_work.data());
+  gq.tail(k).noalias() += QG.bottomLeftCorner(k, pe) * x0.head(pe);
+  for (i = pe - 1; i >= 0; i--)
+    x0.tail(nx - i).applyHouseholderOnTheLeft(W.col(i).tail(nx - i - 1), W_h(i), W_work.data());
+
+  /* the rows of CI and then the bounds, as ranges on Z^T CI and Z^T: the
+     trailing k rows of Q^T (CI I) */
+  QC.resize(nx, mci + nb);
+  yl.resize(mci + nb);
+  yu.resize(mci + nb);
+  QC.leftCols(mci) = CI;
+  QC.rightCols(nb).setIdentity();
+  for (i = 0; i < pe; i++)
+    QC.bottomRows(nx - i).applyHouseholderOnTheLeft(W.col(i).tail(nx - i - 1), W_h(i), W_work.data());
+  yl.head(mci).noalias() = CI.transpose() * x0;
+  yl.head(mci) = -(ci0 + yl.head(mci));
+  yu.head(mci).setConstant(inf);
+  if (nb > 0)
+  {
+    yl.tail(nb) = lb - x0;
+    yu.tail(nb) = ub - x0;
+  }
+  /* sizes 0, which do not allocate */
+  MatrixX Ey(k, 0);
+  VectorX ey(0);
+
+  /* the reduced problem has a solver of its own, so that its workspace 
+     stays allocated between calls, next to the one of solve() */
+  if (reduced.empty())
+    reduced.resize(1);
+  nullspace = true;
+  iter = 0;
+  Scalar f_value = reduced[0].solve_ranged(QG.bottomRightCorner(k, k), gq.tail(k), Ey, ey, 
+                                           QC.bottomRows(k), yl, yu, y);
+  iter = reduced[0].iter;
+  if (f_value == inf)
+    return f_value;
+  /* x = x0 + Z y */
+  x.resize(nx);
+  gq.head(pe).setZero();
+  gq.tail(k) = y;
+  for (i = pe - 1; i >= 0; i--)
+    gq.tail(nx - i).applyHouseholderOnTheLeft(W.col(i).tail(nx - i - 1), W_h(i), W_work.data());
+  x = x0 + gq;
+  gq.noalias() = G * x;
+  return 0.5 * x.dot(gq) + g0.dot(x);
+}
+
+template<typename Scalar>
+void BasicSolver<Scalar>::rank_update(const VectorRef& v, Scalar sigma)
+{
+  int j;
+  Scalar Ljj, wj, swj2, gamma, x, nLjj, beta;
+  if (!factorized)
+    throw std::logic_error("The matrix G has not been factorized");
+  if ((int)v.size() != n)
+  {
+    std::ostringstream msg;
+    msg << "The ublas::vector v is incompatible (incorrect dimension " 
+	<< v.size() << ", expecting " << n << ")";
+    throw std::logic_error(msg.str());
+  }
+  /* with w = J0^T v, J0^T (G + sigma v v^T) J0 = I + sigma w w^T, which is
+     positive definite iff 1 + sigma ||w||^2 > 0; its inverse square root 
+     I + alpha w w^T gives the new J0 */
+  z.noalias() = J0.transpose() * v;
+  Scalar w2 = z.squaredNorm();
+  if (!(1.0 + sigma * w2 > 0.0))
+  {
+    std::ostringstream os;
+    os << "Error in the rank update, G + sigma v v^T is not positive definite "
+       << "(1 + sigma v^T G^-1 v = " << 1.0 + sigma * w2 << ")";
+    throw std::logic_error(os.str());
+  }
+  if (w2 == 0.0)
+    return;
+  Scalar alpha = (1.0 / std::sqrt(1.0 + sigma * w2) - 1.0) / w2;
+  d.noalias() = J0 * z;
+  J0.noalias() += alpha * d * z.transpose();
+
+  /* the rank-one update of the lower triangle of L, column by column, as
+     in Eigen's LLT::rankUpdate() */
+  factorized = false;
+  diagonal = false;
+  d = v;
+  beta = 1.0;
+  for (j = 0; j < n; j++)
+  {
+    int rs = n - j - 1;
+    Ljj = L(j, j);
+    wj = d(j);
+    swj2 = sigma * wj * wj;
+    gamma = Ljj * Ljj * beta + swj2;
+    x = Ljj * Ljj + swj2 / beta;
+    if (!(x > 0.0))
+    {
+      std::ostringstream os;
+      os << "Error in the rank update, G + sigma v v^T is not positive definite "
+	 << "(diagonal element " << j << ")";
+      throw std::logic_error(os.str());
+    }
+    nLjj = std::sqrt(x);
+    L(j, j) = nLjj;
+    beta += swj2 / (Ljj * Ljj);
+    d.tail(rs) -= (wj / Ljj) * L.col(j).tail(rs);
+    if (gamma != 0.0)
+      L.col(j).tail(rs) = (nLjj / Ljj) * L.col(j).tail(rs) + (nLjj * sigma * wj / gamma) * d.tail(rs);
+  }
+  L.template triangularView<StrictlyUpper>() = L.transpose();
+  c1 += sigma * v.squaredNorm();
+  /* trace(L^-1), as J0.trace() after factorize() */
+  c2 = L.diagonal().cwiseInverse().sum();
+  factorized = true;
+}
+
+template<typename Scalar>
+void BasicSolver<Scalar>::factorize_least_squares(const MatrixRef& A)
+{
+  MatrixX QR;
+  VectorX h;
+  factorize_qr(A, QR, h);
+}
+
+template<typename Scalar>
+void BasicSolver<Scalar>::factorize_qr(const MatrixRef& A, MatrixX& QR, VectorX& h)
+{
+  int i;
+  if (A.rows() < A.cols())
+  {
+    std::ostringstream msg;
+    msg << "The ublas::matrix A has fewer rows than columns (" << A.rows() << " x " 
+	<< A.cols() << "), A^T A is singular";
+    throw std::logic_error(msg.str());
+  }
+  /* the workspace is only reallocated when the problem dimensions change */
+  if (A.cols() != n)
+    resize(A.cols(), p, m);
+  factorized = false;
+  diagonal = false;
+#ifdef TRACE_SOLVER
+  print_matrix("A", A);
+#endif  
+
+  /* trace(G) = ||A||_F^2 */
+  c1 = A.squaredNorm();
+  /* A = Q R gives G = R^T R: the upper triangle of L is R, with the signs of
+     its rows chosen for a positive diagonal, and the lower one R^T. The QR
+     is done in place in QR, one reflector per column as in 
+     equality_solution(), with the coefficients in h */
+  int rows = A.rows();
+  QR = A;
+  h.resize(n);
+  for (i = 0; i < n; i++)
+  {
+    Scalar beta;
+    QR.col(i).tail(rows - i).makeHouseholderInPlace(h(i), beta);
+    QR(i, i) = beta;
+    QR.bottomRightCorner(rows - i, n - i - 1).applyHouseholderOnTheLeft(QR.col(i).tail(rows - i - 1), h(i), W_work.data());
+  }
+  L = QR.topRows(n).template triangularView<Upper>();
+  for (i = 0; i < n; i++)
+    if (L(i, i) < 0.0)
+      L.row(i) = -L.row(i);
+  for (i = 0; i < n; i++)
+    if (!(L(i, i) > n * std::numeric_limits<Scalar>::epsilon() * L.diagonal().maxCoeff()))
+    {
+      std::ostringstream os;
+      os << "Error in the QR decomposition of A, A is rank deficient "
+	 << "(diagonal element " << i << ")";
+      throw std::logic_error(os.str());
+    }
+  L.template triangularView<StrictlyLower>() = L.transpose();
+#ifdef TRACE_SOLVER
+  print_matrix("L", L);
+#endif
+
+  /* J0 = L^-T = R^-1 */
+  inverse_cholesky_factor(L, J0);
+  c2 = J0.trace();
+  factorized = true;
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_least_squares(const MatrixRef& A, const VectorRef& b, 
+                                                const MatrixRef& CE, const VectorRef& ce0,  
+                                                const MatrixRef& CI, const VectorRef& ci0, 
+                                                VectorX& x)
+{
+  int i;
+  if (b.size() != A.rows())
+  {
+    std::ostringstream msg;
+    msg << "The ublas::vector b is incompatible (incorrect dimension " 
+	<< b.size() << ", expecting " << A.rows() << ")";
+    throw std::logic_error(msg.str());
+  }
+  MatrixX QR;
+  VectorX h;
+  factorize_qr(A, QR, h);
+  /* 1/2 ||A x - b||^2 = 1/2 x^T G x + g0^T x + 1/2 ||b||^2, with 
+     g0 = -A^T b = -R^T Q^T b. It is formed through Q, with the row signs of
+     R, so that the unconstrained minimizer R^-1 Q^T b keeps the accuracy 
+     of the QR; A^T b would bring back the square of the condition number */
+  VectorX c = b;
+  for (i = 0; i < n; i++)
+    c.tail(A.rows() - i).applyHouseholderOnTheLeft(QR.col(i).tail(A.rows() - i - 1), h(i), W_work.data());
+  for (i = 0; i < n; i++)
+    if (QR(i, i) < 0.0)
+      c(i) = -c(i);
+  VectorX g0 = -(L.template triangularView<Lower>() * c.head(n));
+  /* for the same reason the unconstrained minimizer is passed in x, 
+     rather than recomputed from g0 */
+  x = c.head(n);
+  L.template triangularView<Upper>().solveInPlace(x);
+  x_given = true;
+  Scalar f_value;
+  try
+  {
+    f_value = solve_factored(g0, CE, ce0, CI, ci0, x);
+  }
+  catch (...)
+  {
+    x_given = false;
+    throw;
+  }
+  x_given = false;
+  if (f_value == std::numeric_limits<Scalar>::infinity())
+    return f_value;
+  /* from the residual, rather than f_value + 1/2 ||b||^2, which cancels */
+  return 0.5 * (A * x - b).squaredNorm();
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_factored(const VectorRef& g0, 
+                                           const MatrixRef& CE, const VectorRef& ce0,  
+                                           const MatrixRef& CI, const VectorRef& ci0, 
+                                           VectorX& x)
+{
+  return solve_factored_impl(g0, CE, ce0, CI, ci0, ci0, false, x, false, no_active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_factored(const VectorRef& g0, 
+                                           const MatrixRef& CE, const VectorRef& ce0,  
+                                           const MatrixRef& CI, const VectorRef& ci0, 
+                                           VectorX& x, const VectorXi& active)
+{
+  return solve_factored_impl(g0, CE, ce0, CI, ci0, ci0, false, x, true, active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_factored(const VectorRef& g0, 
+                                           const SparseMatrixX& CE, const VectorRef& ce0,  
+                                           const SparseMatrixX& CI, const VectorRef& ci0, 
+                                           VectorX& x)
+{
+  return solve_factored_impl(g0, CE, ce0, CI, ci0, ci0, false, x, false, no_active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_factored(const VectorRef& g0, 
+                                           const SparseMatrixX& CE, const VectorRef& ce0,  
+                                           const SparseMatrixX& CI, const VectorRef& ci0, 
+                                           VectorX& x, const VectorXi& active)
+{
+  return solve_factored_impl(g0, CE, ce0, CI, ci0, ci0, false, x, true, active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_factored_ranged(const VectorRef& g0, 
+                                                  const MatrixRef& CE, const VectorRef& ce0,  
+                                                  const MatrixRef& CI, const VectorRef& cl, const VectorRef& cu, 
+                                                  VectorX& x)
+{
+  return solve_factored_impl(g0, CE, ce0, CI, cl, cu, true, x, false, no_active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_factored_ranged(const VectorRef& g0, 
+                                                  const MatrixRef& CE, const VectorRef& ce0,  
+                                                  const MatrixRef& CI, const VectorRef& cl, const VectorRef& cu, 
+                                                  VectorX& x, const VectorXi& active)
+{
+  return solve_factored_impl(g0, CE, ce0, CI, cl, cu, true, x, true, active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_factored_ranged(const VectorRef& g0, 
+                                                  const SparseMatrixX& CE, const VectorRef& ce0,  
+                                                  const SparseMatrixX& CI, const VectorRef& cl, const VectorRef& cu, 
+                                                  VectorX& x)
+{
+  return solve_factored_impl(g0, CE, ce0, CI, cl, cu, true, x, false, no_active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_factored_ranged(const VectorRef& g0, 
+                                                  const SparseMatrixX& CE, const VectorRef& ce0,  
+                                                  const SparseMatrixX& CI, const VectorRef& cl, const VectorRef& cu, 
+                                                  VectorX& x, const VectorXi& active)
+{
+  return solve_factored_impl(g0, CE, ce0, CI, cl, cu, true, x, true, active);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_rows(const MatrixRef& G, const VectorRef& g0, 
+                                       const RowMatrixRef& Aeq, const VectorRef& beq,  
+                                       const RowMatrixRef& Ain, const VectorRef& bin, Sense sense, 
+                                       VectorX& x)
+{
+  factorize(G);
+  return solve_factored_rows(g0, Aeq, beq, Ain, bin, sense, x);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::solve_factored_rows(const VectorRef& g0, 
+                                                const RowMatrixRef& Aeq, const VectorRef& beq,  
+                                                const RowMatrixRef& Ain, const VectorRef& bin, 
+                                                Sense sense, VectorX& x)
+{
+  /* CE = Aeq^T and CI = Ain^T are column-major views of the same storage;
+     the rows of Ain are bin <= Ain x < inf, or -inf < Ain x <= bin */
+  row_ce0 = -beq;
+  if (sense == LESS_EQUAL)
+  {
+    row_open.setConstant(Ain.rows(), -std::numeric_limits<Scalar>::infinity());
+    return solve_factored_impl(g0, Aeq.transpose(), row_ce0, Ain.transpose(), row_open, bin, 
+                               true, x, false, no_active);
+  }
+  row_open.setConstant(Ain.rows(), std::numeric_limits<Scalar>::infinity());
+  return solve_factored_impl(g0, Aeq.transpose(), row_ce0, Ain.transpose(), bin, row_open, 
+                             true, x, false, no_active);
+}
+
+/* Row i of the inequalities is lower(i) <= v(i) <= upper(i), where v(i) is
+   column i of CI times x, or x(i - m) for the bounds that follow the m
+   columns of CI. At its active end (side) the row reads np^T x + b >= 0 */
+template<typename Scalar, typename MatrixI>
+inline Scalar inequality_value(const MatrixI& CI, const Matrix<Scalar, Dynamic, 1>& x, int i)
+{
+  return i < CI.cols() ? CI.col(i).dot(x) : x(i - CI.cols());
+}
+
+/* the end of row i which x violates (or is nearer to) */
+template<typename Scalar, typename MatrixI>
+inline int inequality_side(const MatrixI& CI, const Matrix<Scalar, Dynamic, 1>& lower, 
+                           const Matrix<Scalar, Dynamic, 1>& upper, 
+                           const Matrix<Scalar, Dynamic, 1>& x, int i)
+{
+  Scalar v = inequality_value(CI, x, i);
+  return v - lower(i) <= upper(i) - v ? 1 : -1;
+}
+
+template<typename Scalar, typename MatrixI>
+inline void inequality_normal(Matrix<Scalar, Dynamic, 1>& np, const MatrixI& CI, int i, int side)
+{
+  if (i < CI.cols())
+  {
+    np = CI.col(i);
+    if (side < 0)
+      np = -np;
+  }
+  else
+  {
+    np.setZero();
+    np(i - CI.cols()) = side;
+  }
+}
+
+template<typename Scalar, typename MatrixI>
+inline void inequality_d(Matrix<Scalar, Dynamic, 1>& d, const Matrix<Scalar, Dynamic, Dynamic>& J, 
+                         const Matrix<Scalar, Dynamic, 1>& np, const MatrixI& CI, 
+                         int i, int side)
+{
+  /* for a bound np is a signed unit vector, so J^T np is a row of J */
+  if (i < CI.cols())
+    compute_d(d, J, np, CI, i);
+  else
+    d = side * J.row(i - CI.cols()).transpose();
+}
+
+template<typename Scalar>
+inline Scalar inequality_offset(const Matrix<Scalar, Dynamic, 1>& lower, 
+                                const Matrix<Scalar, Dynamic, 1>& upper, int i, int side)
+{
+  return side > 0 ? -lower(i) : upper(i);
+}
+
+template<typename Scalar, typename MatrixI>
+inline Scalar inequality_slack(const MatrixI& CI, const Matrix<Scalar, Dynamic, 1>& lower, 
+                               const Matrix<Scalar, Dynamic, 1>& upper, 
+                               const Matrix<Scalar, Dynamic, 1>& x, int i, int side)
+{
+  Scalar v = inequality_value(CI, x, i);
+  return side > 0 ? v - lower(i) : upper(i) - v;
+}
+
+template<typename Scalar>
+template<typename MatrixE, typename MatrixI>
+Scalar BasicSolver<Scalar>::solve_factored_impl(const VectorRef& g0, 
+                                                const MatrixE& CE, const VectorRef& ce0,  
+                                                const MatrixI& CI, const VectorRef& b0, const VectorRef& b1, 
+                                                bool ranged, VectorX& x, bool warm, const VectorXi& active)
+{
+  {
+    //Ensure that the dimensions of the matrices and ublas::vectors can be
+    //safely converted from unsigned int into to int without overflow.
+    unsigned mx = std::numeric_limits<int>::max();
+    if(CE.rows() >= mx || CE.cols() >= mx ||
+       CI.rows() >= mx || CI.cols() >= mx || 
+       b0.size() >= mx || ce0.size() >= mx || g0.size() >= mx){
+      std::ostringstream msg;
+      msg << "The dimensions of one of the input matrices or ublas::vectors were "
+	  << "too large." << std::endl
+	  << "The maximum allowable size for inputs to solve_quadprog is:"
+	  << mx << std::endl;
+      throw std::logic_error(msg.str());
+    }
+  }
+  if (!factorized)
+    throw std::logic_error("The matrix G has not been factorized");
+  if (lb.size() != 0 && (int)lb.size() != n)
+  {
+    std::ostringstream msg;
+    msg << "The bounds lb and ub are incompatible (incorrect dimension " 
+	<< lb.size() << ", expecting " << n << ")";
+    throw std::logic_error(msg.str());
+  }
+  /* a resumed solve needs the state of the last one, for the same sizes */
+  bool hot = resume && iq >= p && !direct;
+  resume = false;
+  direct = false;
+  nullspace = false;
+  /* the workspace is only reallocated when the problem dimensions change */
+  if (CE.cols() != p || CI.cols() + lb.size() != m)
+  {
+    resize(n, CE.cols(), CI.cols() + lb.size());
+    hot = false;
+  }
+  if ((int)g0.size() != n)
+  {
+    std::ostringstream msg;
+    msg << "The ublas::vector g0 is incompatible (incorrect dimension " 
+	<< g0.size() << ", expecting " << n << ")";
+    throw std::logic_error(msg.str());
+  }
   if ((int)CE.rows() != n)
   {
+    std::ostringstream msg;
     msg << "The ublas::matrix CE is incompatible (incorrect number of rows " 
 	<< CE.rows() << " , expecting " << n << ")";
     throw std::logic_error(msg.str());
   }
   if ((int)ce0.size() != p)
   {
+    std::ostringstream msg;
     msg << "The ublas::vector ce0 is incompatible (incorrect dimension " 
 	<< ce0.size() << ", expecting " << p << ")";
     throw std::logic_error(msg.str());
   }
   if ((int)CI.rows() != n)
   {
+    std::ostringstream msg;
     msg << "The ublas::matrix CI is incompatible (incorrect number of rows " 
 	<< CI.rows() << " , expecting " << n << ")";
     throw std::logic_error(msg.str());
   }
-  if ((int)ci0.size() != m)
+  if (b0.size() != CI.cols() || (ranged && b1.size() != CI.cols()))
   {
-    msg << "The ublas::vector ci0 is incompatible (incorrect dimension " 
-	<< ci0.size() << ", expecting " << m << ")";
+    std::ostringstream msg;
+    msg << "The ublas::vector " << (ranged ? "cl or cu" : "ci0") 
+        << " is incompatible (incorrect dimension " 
+	<< (b0.size() != CI.cols() ? b0.size() : b1.size()) 
+	<< ", expecting " << CI.cols() << ")";
     throw std::logic_error(msg.str());
   }
   x.resize(n);
-  register int i, j, k, l; /* indices */
+  int i, j, k, l; /* indices */
   int ip; // this is the index of the constraint to be added to the active set
-  MatrixXd R(n, n), J(n, n);
-  VectorXd s(m + p), z(n), r(m + p), d(n), np(n), u(m + p), x_old(n), u_old(m + p);
-  double f_value, psi, c1, c2, sum, ss, R_norm;
-  double inf;
-  if (std::numeric_limits<double>::has_infinity)
-    inf = std::numeric_limits<double>::infinity();
+  Scalar f_value, psi, ss, R_norm;
+  Scalar inf;
+  if (std::numeric_limits<Scalar>::has_infinity)
+    inf = std::numeric_limits<Scalar>::infinity();
   else
     inf = 1.0E300;
-  double t, t1, t2; /* t is the step lenght, which is the minimum of the partial step length t1 
+  Scalar t, t1, t2; /* t is the step lenght, which is the minimum of the partial step length t1 
     * and the full step length t2 */
-  VectorXi A(m + p), A_old(m + p), iai(m + p);
-  int q, iq, iter = 0;
-  vector<bool> iaexcl(m + p);
+  iter = 0;
 	
   /* p is the number of equality constraints */
   /* m is the number of inequality constraints */
-  q = 0;  /* size of the active set A (containing the indices of the active constraints) */
 #ifdef TRACE_SOLVER
   std::cout << std::endl << "Starting solve_quadprog" << std::endl;
-  print_ublas::matrix("G", G);
   print_ublas::vector("g0", g0);
   print_ublas::matrix("CE", CE);
   print_ublas::vector("ce0", ce0);
   print_ublas::matrix("CI", CI);
-  print_ublas::vector("ci0", ci0);
+  print_ublas::vector("b0", b0);
 #endif  
   
-  /*
-   * Preprocessing phase
-   */
-	
-  /* compute the trace of the original ublas::matrix G */
-  c1 = 0.0;
-  for (i = 0; i < n; i++)
+  /* the ends of every inequality row: a one-sided constraint has no upper
+     end, and the bounds follow the columns of CI */
+  if (ranged)
   {
-    c1 += G(i, i);
+    lower.head(CI.cols()) = b0;
+    upper.head(CI.cols()) = b1;
   }
-  /* decompose the ublas::matrix G in the form L^T L */
-  cholesky_decomposition(G);
-#ifdef TRACE_SOLVER
-  print_matrix("G", G);
-#endif
+  else
+  {
+    lower.head(CI.cols()) = -b0;
+    upper.head(CI.cols()).setConstant(inf);
+  }
+  if (lb.size() > 0)
+  {
+    lower.tail(n) = lb;
+    upper.tail(n) = ub;
+  }
+  /* step 2 only checks the rows out of the active set, so a row with
+     lower(i) > upper(i) would be made active at one end while it violates
+     the other: no x satisfies it, and the problem is rejected here */
+  for (i = 0; i < m; i++)
+    if (lower(i) > upper(i))
+    {
+      iq = 0;
+      iter = 0;
+      direct = true;
+      return inf;
+    }
+
+  /* without any inequality the KKT system of the equalities gives x in 
+     one solve, with no iteration; see equality_solution() */
+  if (m == 0 && !x_given)
+    return equality_solution(g0, CE, ce0, x);
+  /* so does a warm start with no inequality active, as long as that x 
+     passes the test of step 1; otherwise it falls back to the iterations,
+     which rebuild J and R from scratch */
+  if (warm && active.size() == 0 && !hot && !x_given)
+  {
+    f_value = equality_solution(g0, CE, ce0, x);
+    s.head(CI.cols()).noalias() = CI.transpose() * x;
+    if (lb.size() > 0)
+      s.segment(CI.cols(), n) = x;
+    s.head(m) = (s.head(m) - lower).cwiseMin(upper - s.head(m));
+    psi = s.head(m).cwiseMin(0.0).sum();
+    if (std::abs(psi) <= m * std::numeric_limits<Scalar>::epsilon() * c1 * c2 * infeasibility_margin<Scalar>())
+      return f_value;
+    direct = false;
+  }
+
+  if (hot)
+  {
+    /* J, R and the active set A are those of the last solve, where only the
+       offsets have changed since: x and u are recomputed for that set */
+    f_value = resume_active_set(g0, ce0, x, R_norm);
+    goto l0;
+  }
+  
   /* initialize the ublas::matrix R */
   for (i = 0; i < n; i++)
   {
@@ -179,20 +1132,8 @@ double solve_quadprog(MatrixXd& G, VectorXd& g0,
   }
   R_norm = 1.0; /* this variable will hold the norm of the ublas::matrix R */
   
-  /* compute the inverse of the factorized ublas::matrix G^-1, this is the initial value for H */
-  c2 = 0.0;
-  for (i = 0; i < n; i++) 
-  {
-    d(i) = 1.0;
-    forward_elimination(G, z, d);
-    for (j = 0; j < n; j++)
-      J(i, j) = z(j);
-    c2 += z(i);
-    d(i) = 0.0;
-  }
-#ifdef TRACE_SOLVER
-  print_ublas::matrix("J", J);
-#endif
+  /* the initial value for H is the inverse of the Cholesky factor of G */
+  J = J0;
   
   /* c1 * c2 is an estimate for cond(G) */
   
@@ -201,11 +1142,22 @@ double solve_quadprog(MatrixXd& G, VectorXd& g0,
    * this is a feasible point in the dual space
    * x = G^-1 * g0
    */
-  cholesky_solve(G, x, g0);
-  for (i = 0; i < n; i++)
-    x(i) = -x(i);
+  if (x_given)
+    ; /* x holds it already, see solve_least_squares() */
+  else if (diagonal)
+    x = -g0.cwiseQuotient(L.diagonal()).cwiseQuotient(L.diagonal());
+  else
+  {
+    /* same as cholesky_solve(L, x, g0), but using x and z as scratch space to
+     * avoid allocating a temporary */
+    x = g0;
+    forward_elimination(L, z, x);
+    backward_elimination(L, x, z);
+    for (i = 0; i < n; i++)
+      x(i) = -x(i);
+  }
   /* and compute the current solution value */ 
-  f_value = 0.5 * scalar_product(g0, x);
+  f_value = 0.5 * g0.dot(x);
 #ifdef TRACE_SOLVER
   std::cout << "Unconstrained solution: " << f_value << std::endl;
   print_ublas::vector("x", x);
@@ -215,9 +1167,8 @@ double solve_quadprog(MatrixXd& G, VectorXd& g0,
   iq = 0;
   for (i = 0; i < p; i++)
   {
-    for (j = 0; j < n; j++)
-      np(j) = CE(j, i);
-    compute_d(d, J, np);
+    np = CE.col(i);
+    compute_d(d, J, np, CE, i);
     update_z(z, J, d, iq);
     update_r(R, r, d, iq);
 #ifdef TRACE_SOLVER
@@ -230,7 +1181,7 @@ double solve_quadprog(MatrixXd& G, VectorXd& g0,
     /* compute full step length t2: i.e., the minimum step in primal space s.t. the contraint 
       becomes feasible */
     t2 = 0.0;
-    if (fabs(scalar_product(z, z)) > std::numeric_limits<double>::epsilon()) // i.e. z != 0
+    if (std::abs(scalar_product(z, z)) > std::numeric_limits<Scalar>::epsilon()) // i.e. z != 0
       t2 = (-scalar_product(np, x) - ce0(i)) / scalar_product(z, np);
     
     /* set x = x + t2 * z */
@@ -254,8 +1205,12 @@ double solve_quadprog(MatrixXd& G, VectorXd& g0,
     }
   }
   
+  /* Rebuild R and J for the initial active set given by the caller */
+  if (active.size() > 0)
+    f_value = add_active_set(g0, ce0, CI, active, x, R_norm);
+  
   /* set iai = K \ A */
-  for (i = 0; i < m; i++)
+l0:	for (i = 0; i < m; i++)
     iai(i) = i;
   
 l1:	iter++;
@@ -269,30 +1224,26 @@ l1:	iter++;
     iai(ip) = -1;
   }
 	
-  /* compute s(x) = ci^T * x + ci0 for all elements of K \ A */
+  /* compute s(x), the slack of the nearer end of each row, for all elements of K \ A */
   ss = 0.0;
   psi = 0.0; /* this value will contain the sum of all infeasibilities */
   ip = 0; /* ip will be the index of the chosen violated constraint */
-  for (i = 0; i < m; i++)
-  {
-    iaexcl[i] = true;
-    sum = 0.0;
-    for (j = 0; j < n; j++)
-      sum += CI(j, i) * x(j);
-    sum += ci0(i);
-    s(i) = sum;
-    psi += std::min(0.0, sum);
-  }
+  /* a single matrix-vector product rather than m dot products; every
+     element is recomputed from x, so no error accumulates across steps */
+  s.head(CI.cols()).noalias() = CI.transpose() * x;
+  if (lb.size() > 0)
+    s.segment(CI.cols(), n) = x;
+  s.head(m) = (s.head(m) - lower).cwiseMin(upper - s.head(m));
+  psi = s.head(m).cwiseMin(0.0).sum();
+  std::fill(iaexcl.begin(), iaexcl.end(), true);
 #ifdef TRACE_SOLVER
   print_ublas::vector("s", s, m);
 #endif
   
   
-  if (fabs(psi) <= m * std::numeric_limits<double>::epsilon() * c1 * c2* 100.0)
+  if (std::abs(psi) <= m * std::numeric_limits<Scalar>::epsilon() * c1 * c2 * infeasibility_margin<Scalar>())
   {
     /* numerically there are not infeasibilities anymore */
-    q = iq;
-    
     return f_value;
   }
   
@@ -317,14 +1268,12 @@ l2: /* Step 2: check for feasibility and determine a new S-pair */
     }
   if (ss >= 0.0)
   {
-    q = iq;
-    
     return f_value;
   }
   
   /* set np = n(ip) */
-  for (i = 0; i < n; i++)
-    np(i) = CI(i, ip);
+  side(ip) = inequality_side(CI, lower, upper, x, ip);
+  inequality_normal(np, CI, ip, side(ip));
   /* set u = (u 0)^T */
   u(iq) = 0.0;
   /* add ip to the active set A */
@@ -337,7 +1286,7 @@ l2: /* Step 2: check for feasibility and determine a new S-pair */
   
 l2a:/* Step 2a: determine step direction */
     /* compute z = H np: the step direction in the primal space (through J, see the paper) */
-    compute_d(d, J, np);
+    inequality_d(d, J, np, CI, ip, side(ip));
   update_z(z, J, d, iq);
   /* compute N* np (if q > 0): the negative of the step direction in the dual space */
   update_r(R, r, d, iq);
@@ -367,7 +1316,7 @@ l2a:/* Step 2a: determine step direction */
     }
   }
   /* Compute t2: full step length (minimum step in primal space such that the constraint ip becomes feasible */
-  if (fabs(scalar_product(z, z))  > std::numeric_limits<double>::epsilon()) // i.e. z != 0
+  if (std::abs(scalar_product(z, z))  > std::numeric_limits<Scalar>::epsilon()) // i.e. z != 0
     t2 = -s(ip) / scalar_product(z, np);
   else
     t2 = inf; /* +inf */
@@ -385,7 +1334,6 @@ l2a:/* Step 2a: determine step direction */
   {
     /* QPP is infeasible */
     // FIXME: unbounded to raise
-    q = iq;
     return inf;
   }
   /* case (ii): step in dual space */
@@ -427,7 +1375,7 @@ l2a:/* Step 2a: determine step direction */
   print_ublas::vector("A", A, iq + 1);
 #endif
   
-  if (fabs(t - t2) < std::numeric_limits<double>::epsilon())
+  if (std::abs(t - t2) < std::numeric_limits<Scalar>::epsilon())
   {
 #ifdef TRACE_SOLVER
     std::cout << "Full step has taken " << t << std::endl;
@@ -479,11 +1427,8 @@ l2a:/* Step 2a: determine step direction */
   print_ublas::vector("A", A, iq);
 #endif
   
-  /* update s(ip) = CI * x + ci0 */
-  sum = 0.0;
-  for (k = 0; k < n; k++)
-    sum += CI(k, ip) * x(k);
-  s(ip) = sum + ci0(ip);
+  /* update s(ip) = CI * x + ci0, at the end of row ip being added */
+  s(ip) = inequality_slack(CI, lower, upper, x, ip, side(ip));
   
 #ifdef TRACE_SOLVER
   print_ublas::vector("s", s, m);
@@ -491,57 +1436,269 @@ l2a:/* Step 2a: determine step direction */
   goto l2a;
 }
 
-inline void compute_d(VectorXd& d, const MatrixXd& J, const VectorXd& np)
+template<typename Scalar>
+void BasicSolver<Scalar>::get_active_set(VectorXi& active, VectorX& u) const
 {
-  register int i, j, n = d.size();
-  register double sum;
-  
-  /* compute d = H^T * np */
-  for (i = 0; i < n; i++)
+  /* numbered as in solve(), see solve_nullspace() */
+  if (nullspace)
   {
-    sum = 0.0;
-    for (j = 0; j < n; j++)
-      sum += J(j, i) * np(j);
-    d(i) = sum;
+    reduced[0].get_active_set(active, u);
+    return;
+  }
+  active.resize(iq - p);
+  u.resize(iq - p);
+  for (int i = p; i < iq; i++)
+  {
+    active(i - p) = side(A(i)) > 0 ? A(i) : -A(i) - 1;
+    u(i - p) = this->u(i);
   }
 }
 
-inline void update_z(VectorXd& z, const MatrixXd& J, const VectorXd& d, int iq)
+template<typename Scalar>
+template<typename MatrixI>
+Scalar BasicSolver<Scalar>::add_active_set(const VectorRef& g0, const VectorRef& ce0,
+                                           const MatrixI& CI, const VectorXi& active, 
+                                           VectorX& x, Scalar& R_norm)
 {
-  register int i, j, n = z.size();
-	
-  /* setting of z = H * d */
-  for (i = 0; i < n; i++)
+  int i, k, l, sd;
+
+  /* add each constraint to R and J, as if it were an equality; the primal 
+     and dual variables are recomputed in one go afterwards */
+  for (k = 0; k < active.size() && iq < n; k++)
   {
-    z(i) = 0.0;
-    for (j = iq; j < n; j++)
-      z(i) += J(i, j) * d(j);
+    /* row l, at its upper end if written -l - 1 */
+    l = active(k) >= 0 ? active(k) : -active(k) - 1;
+    sd = active(k) >= 0 ? 1 : -1;
+    if (l >= m)
+    {
+      std::ostringstream msg;
+      msg << "The initial active set is incompatible (constraint index " 
+          << active(k) << " out of range, expecting " << -m << " to " << m - 1 << ")";
+      throw std::logic_error(msg.str());
+    }
+    for (i = p; i < iq; i++)
+      if (A(i) == l)
+        break;
+    if (i < iq)
+      continue;
+    /* an end at infinity can never be active */
+    if (std::abs(inequality_offset(lower, upper, l, sd)) == std::numeric_limits<Scalar>::infinity())
+      continue;
+    side(l) = sd;
+    inequality_normal(np, CI, l, sd);
+    inequality_d(d, J, np, CI, l, sd);
+    /* a row dependent on the set up to rounding leaves only rounding in
+       J2^T np, which add_constraint() may not tell from a small column of
+       R; it is left to the iterations, whose step lengths handle it */
+    if (d.tail(n - iq).norm() <= n * std::numeric_limits<Scalar>::epsilon() * infeasibility_margin<Scalar>() * d.norm())
+      continue;
+    A(iq) = l;
+    if (!add_constraint(R, J, d, iq, R_norm))
+    {
+      /* linearly dependent on the constraints already in the set: drop the
+         column of R that was just added, J is still a valid basis */
+      iq--;
+      for (i = 0; i <= iq; i++)
+        R(i, iq) = 0.0;
+    }
   }
+
+  return dual_feasible_solution(g0, ce0, x);
 }
 
-inline void update_r(const MatrixXd& R, VectorXd& r, const VectorXd& d, int iq)
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::resume_active_set(const VectorRef& g0, const VectorRef& ce0,
+                                              VectorX& x, Scalar& R_norm)
 {
-  register int i, j;/*, n = d.size();*/
-  register double sum;
-  
-  /* setting of r = R^-1 d */
-  for (i = iq - 1; i >= 0; i--)
+  int i;
+
+  R_norm = 1.0;
+  for (i = 0; i < iq; i++)
+    R_norm = std::max<Scalar>(R_norm, std::abs(R(i, i)));
+  /* an end that was moved to infinity is no longer active */
+  for (i = iq - 1; i >= p; i--)
+    if (std::abs(inequality_offset(lower, upper, A(i), side(A(i)))) == std::numeric_limits<Scalar>::infinity())
+      delete_constraint(R, J, A, u, n, p, iq, A(i));
+  return dual_feasible_solution(g0, ce0, x);
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::dual_feasible_solution(const VectorRef& g0, const VectorRef& ce0,
+                                                   VectorX& x)
+{
+  int i, l;
+  Scalar f_value, umin;
+
+  /* the dual method needs a dual feasible starting point: drop the active
+     inequality with the most negative multiplier until there is none left */
+  for (;;)
+  {
+    f_value = active_set_solution(g0, ce0, x);
+    umin = 0.0;
+    l = -1;
+    for (i = p; i < iq; i++)
+      if (u(i) < umin)
+      {
+        umin = u(i);
+        l = A(i);
+      }
+    if (l == -1)
+      return f_value;
+    delete_constraint(R, J, A, u, n, p, iq, l);
+  }
+}
+
+template<typename Scalar>
+template<typename MatrixE>
+Scalar BasicSolver<Scalar>::equality_solution(const VectorRef& g0, const MatrixE& CE, 
+                                              const VectorRef& ce0, VectorX& x)
+{
+  int i;
+  Scalar R_norm = 1.0;
+
+  /* more than n equalities cannot be independent, and R would not fit in W */
+  if (p > n)
+    throw std::runtime_error("Constraints are linearly dependent");
+
+  /* G x + g0 = CE u and CE^T x + ce0 = 0. With G = L L^T, h = L^-1 g0 and
+     the QR decomposition L^-1 CE = Q (R 0)^T, this is the solution of
+     active_set_solution() for J = L^-T Q:
+     x = -L^-T Q (R^-T ce0, Q2^T h)   and   u = R^-1 (Q1^T h - R^-T ce0).
+     The Givens sweeps of the iterative path compute the same R, one 
+     column at a time; here it takes a single Householder QR, done in place
+     in W so that it needs no allocation */
+  W = CE;
+  L.template triangularView<Lower>().solveInPlace(W);
+  for (i = 0; i < p; i++)
+  {
+    Scalar beta;
+    W.col(i).tail(n - i).makeHouseholderInPlace(W_h(i), beta);
+    W(i, i) = beta;
+    W.bottomRightCorner(n - i, p - i - 1).applyHouseholderOnTheLeft(W.col(i).tail(n - i - 1), W_h(i), W_work.data());
+    if (std::abs(beta) <= std::numeric_limits<Scalar>::epsilon() * R_norm)
+      // Equality constraints are linearly dependent
+      throw std::runtime_error("Constraints are linearly dependent");
+    R_norm = std::max<Scalar>(R_norm, std::abs(beta));
+  }
+  x = g0;
+  L.template triangularView<Lower>().solveInPlace(x);
+  for (i = 0; i < p; i++)
+    x.tail(n - i).applyHouseholderOnTheLeft(W.col(i).tail(n - i - 1), W_h(i), W_work.data());
+  /* u = R^-1 (Q1^T h - R^-T ce0), and Q1^T h is replaced by R^-T ce0 */
+  np.head(p) = ce0;
+  W.topRows(p).template triangularView<Upper>().transpose().solveInPlace(np.head(p));
+  r.head(p) = x.head(p) - np.head(p);
+  W.topRows(p).template triangularView<Upper>().solveInPlace(r.head(p));
+  x.head(p) = np.head(p);
+  for (i = p - 1; i >= 0; i--)
+    x.tail(n - i).applyHouseholderOnTheLeft(W.col(i).tail(n - i - 1), W_h(i), W_work.data());
+  L.template triangularView<Lower>().transpose().solveInPlace(x);
+  x = -x;
+  /* with nearly dependent equalities R^-T ce0 loses the accuracy that the
+     iterative path keeps: one step of refinement on the residual 
+     e = CE^T x + ce0 gives x -= L^-T Q (R^-T e, 0) and u -= R^-1 R^-T e */
+  np.head(p).noalias() = CE.transpose() * x;
+  np.head(p) += ce0;
+  W.topRows(p).template triangularView<Upper>().transpose().solveInPlace(np.head(p));
+  d.head(p) = np.head(p);
+  d.tail(n - p).setZero();
+  for (i = p - 1; i >= 0; i--)
+    d.tail(n - i).applyHouseholderOnTheLeft(W.col(i).tail(n - i - 1), W_h(i), W_work.data());
+  L.template triangularView<Lower>().transpose().solveInPlace(d);
+  x -= d;
+  W.topRows(p).template triangularView<Upper>().solveInPlace(np.head(p));
+  r.head(p) -= np.head(p);
+
+  /* the equalities make up the active set, but J and R were not built 
+     for it: a resumed solve or a refinement cannot start from them */
+  for (i = 0; i < p; i++)
   {
-    sum = 0.0;
-    for (j = i + 1; j < iq; j++)
-      sum += R(i, j) * r(j);
-    r(i) = (d(i) - sum) / R(i, i);
+    A(i) = -i - 1;
+    u(i) = r(i);
   }
+  iq = p;
+  iter = 0;
+  direct = true;
+  return 0.5 * (g0.dot(x) - u.head(p).dot(ce0));
+}
+
+template<typename Scalar>
+Scalar BasicSolver<Scalar>::active_set_solution(const VectorRef& g0, const VectorRef& ce0,
+                                                VectorX& x)
+{
+  /* For the active constraints N^T x + b = 0, with J^T N = (R 0)^T,
+     x = -J2 J2^T g0 - J1 R^-T b   and   u = R^-1 (J1^T g0 - R^-T b) 
+     where J1 and J2 are the first iq and the last n - iq columns of J */
+  for (int i = 0; i < iq; i++)
+    d(i) = A(i) < 0 ? ce0(-A(i) - 1) : inequality_offset(lower, upper, A(i), side(A(i)));
+  np.head(iq) = d.head(iq);
+  R.topLeftCorner(iq, iq).template triangularView<Upper>().transpose().solveInPlace(np.head(iq));
+  z.tail(n - iq).noalias() = J.rightCols(n - iq).transpose() * g0;
+  x.noalias() = -J.rightCols(n - iq) * z.tail(n - iq);
+  x.noalias() -= J.leftCols(iq) * np.head(iq);
+  r.head(iq).noalias() = J.leftCols(iq).transpose() * g0;
+  r.head(iq) -= np.head(iq);
+  R.topLeftCorner(iq, iq).template triangularView<Upper>().solveInPlace(r.head(iq));
+  u.head(iq) = r.head(iq);
+  /* from G x + g0 = N u it follows that f = 0.5 (g0^T x - u^T b) */
+  return 0.5 * (g0.dot(x) - r.head(iq).dot(d.head(iq)));
+}
+
+template<typename Scalar>
+inline void compute_d(Matrix<Scalar, Dynamic, 1>& d, const Matrix<Scalar, Dynamic, Dynamic>& J, 
+                      const Matrix<Scalar, Dynamic, 1>& np)
+{
+  /* compute d = H^T * np */
+  d.noalias() = J.transpose() * np;
 }
 
-bool add_constraint(MatrixXd& R, MatrixXd& J, VectorXd& d, int& iq, double& R_norm)
+/* d = J^T np, where np is column i of the constraint matrix C */
+template<typename Scalar, typename Derived>
+inline void compute_d(Matrix<Scalar, Dynamic, 1>& d, const Matrix<Scalar, Dynamic, Dynamic>& J, 
+                      const Matrix<Scalar, Dynamic, 1>& np, const MatrixBase<Derived>& C, int i)
+{
+  compute_d(d, J, np);
+}
+
+template<typename Scalar>
+inline void compute_d(Matrix<Scalar, Dynamic, 1>& d, const Matrix<Scalar, Dynamic, Dynamic>& J, 
+                      const Matrix<Scalar, Dynamic, 1>& np, const SparseMatrix<Scalar>& C, int i)
+{
+  /* only the rows of J matching the nonzeros of np contribute */
+  d.setZero();
+  for (typename SparseMatrix<Scalar>::InnerIterator it(C, i); it; ++it)
+    d += np(it.index()) * J.row(it.index()).transpose();
+}
+
+template<typename Scalar>
+inline void update_z(Matrix<Scalar, Dynamic, 1>& z, const Matrix<Scalar, Dynamic, Dynamic>& J, 
+                     const Matrix<Scalar, Dynamic, 1>& d, int iq)
+{
+  int n = z.size();
+	
+  /* setting of z = H * d */
+  z.noalias() = J.rightCols(n - iq) * d.tail(n - iq);
+}
+
+template<typename Scalar>
+inline void update_r(const Matrix<Scalar, Dynamic, Dynamic>& R, Matrix<Scalar, Dynamic, 1>& r, 
+                     const Matrix<Scalar, Dynamic, 1>& d, int iq)
+{
+  /* setting of r = R^-1 d */
+  r.head(iq) = d.head(iq);
+  R.topLeftCorner(iq, iq).template triangularView<Upper>().solveInPlace(r.head(iq));
+}
+
+template<typename Scalar>
+bool add_constraint(Matrix<Scalar, Dynamic, Dynamic>& R, Matrix<Scalar, Dynamic, Dynamic>& J, 
+                    Matrix<Scalar, Dynamic, 1>& d, int& iq, Scalar& R_norm)
 {
   int n = d.size();
 #ifdef TRACE_SOLVER
   std::cout << "Add constraint " << iq << '/';
 #endif
-  register int i, j, k;
-  double cc, ss, h, t1, t2, xny;
+  int i, j;
+  Scalar cc, ss, h, xny;
 	
   /* we have to find the Givens rotation which will reduce the element
     d(j) to zero.
@@ -560,7 +1717,7 @@ bool add_constraint(MatrixXd& R, MatrixXd& J, VectorXd& d, int& iq, double& R_no
     cc = d(j - 1);
     ss = d(j);
     h = distance(cc, ss);
-    if (fabs(h) < std::numeric_limits<double>::epsilon()) // h == 0
+    if (std::abs(h) < std::numeric_limits<Scalar>::epsilon()) // h == 0
       continue;
     d(j) = 0.0;
     ss = ss / h;
@@ -574,13 +1731,7 @@ bool add_constraint(MatrixXd& R, MatrixXd& J, VectorXd& d, int& iq, double& R_no
     else
       d(j - 1) = h;
     xny = ss / (1.0 + cc);
-    for (k = 0; k < n; k++)
-    {
-      t1 = J(k, j - 1);
-      t2 = J(k, j);
-      J(k, j - 1) = t1 * cc + t2 * ss;
-      J(k, j) = xny * (t1 + J(k, j - 1)) - t2;
-    }
+    apply_givens(&J(0, j - 1), &J(0, j), n, cc, ss, xny);
   }
   /* update the number of constraints added*/
   iq++;
@@ -596,22 +1747,24 @@ bool add_constraint(MatrixXd& R, MatrixXd& J, VectorXd& d, int& iq, double& R_no
   print_ublas::vector("d", d, iq);
 #endif
   
-  if (fabs(d(iq - 1)) <= std::numeric_limits<double>::epsilon() * R_norm) 
+  if (std::abs(d(iq - 1)) <= std::numeric_limits<Scalar>::epsilon() * R_norm) 
   {
     // problem degenerate
     return false;
   }
-  R_norm = std::max<double>(R_norm, fabs(d(iq - 1)));
+  R_norm = std::max<Scalar>(R_norm, std::abs(d(iq - 1)));
   return true;
 }
 
-void delete_constraint(MatrixXd& R, MatrixXd& J, VectorXi& A, VectorXd& u, int n, int p, int& iq, int l)
+template<typename Scalar>
+void delete_constraint(Matrix<Scalar, Dynamic, Dynamic>& R, Matrix<Scalar, Dynamic, Dynamic>& J, 
+                       VectorXi& A, Matrix<Scalar, Dynamic, 1>& u, int n, int p, int& iq, int l)
 {
 #ifdef TRACE_SOLVER
   std::cout << "Delete constraint " << l << ' ' << iq;
 #endif
-  register int i, j, k, qq = -1; // just to prevent warnings from smart compilers
-  double cc, ss, h, xny, t1, t2;
+  int i, j, k, qq = -1; // just to prevent warnings from smart compilers
+  Scalar cc, ss, h, xny, t1, t2;
   
   /* Find the index qq for active constraint l to be removed */
   for (i = p; i < iq; i++)
@@ -650,7 +1803,7 @@ void delete_constraint(MatrixXd& R, MatrixXd& J, VectorXi& A, VectorXd& u, int n
     cc = R(j, j);
     ss = R(j + 1, j);
     h = distance(cc, ss);
-    if (fabs(h) < std::numeric_limits<double>::epsilon()) // h == 0
+    if (std::abs(h) < std::numeric_limits<Scalar>::epsilon()) // h == 0
       continue;
     cc = cc / h;
     ss = ss / h;
@@ -672,84 +1825,144 @@ void delete_constraint(MatrixXd& R, MatrixXd& J, VectorXi& A, VectorXd& u, int n
       R(j, k) = t1 * cc + t2 * ss;
       R(j + 1, k) = xny * (t1 + R(j, k)) - t2;
     }
-    for (k = 0; k < n; k++)
-    {
-      t1 = J(k, j);
-      t2 = J(k, j + 1);
-      J(k, j) = t1 * cc + t2 * ss;
-      J(k, j + 1) = xny * (J(k, j) + t1) - t2;
-    }
+    apply_givens(&J(0, j), &J(0, j + 1), n, cc, ss, xny);
+  }
+}
+
+/* Applies a Givens rotation to the columns x and y of J, in the form used by
+   add_constraint and delete_constraint: x' = cc x + ss y and
+   y' = xny (x + x') - y. The columns are contiguous and never overlap, so
+   the loop is compiled to packed SIMD arithmetic */
+template<typename Scalar>
+inline void apply_givens(Scalar* __restrict x, Scalar* __restrict y, int n, Scalar cc, Scalar ss, 
+                         Scalar xny)
+{
+#pragma omp simd
+  for (int k = 0; k < n; k++)
+  {
+    Scalar t1 = x[k], t2 = y[k];
+    x[k] = t1 * cc + t2 * ss;
+    y[k] = xny * (t1 + x[k]) - t2;
   }
 }
 
-inline double distance(double a, double b)
+template<typename Scalar>
+inline Scalar distance(Scalar a, Scalar b)
 {
-  register double a1, b1, t;
-  a1 = fabs(a);
-  b1 = fabs(b);
+  Scalar a1, b1, t;
+  a1 = std::abs(a);
+  b1 = std::abs(b);
   if (a1 > b1) 
   {
     t = (b1 / a1);
-    return a1 * ::std::sqrt(1.0 + t * t);
+    return a1 * ::std::sqrt(Scalar(1) + t * t);
   }
   else
     if (b1 > a1)
     {
       t = (a1 / b1);
-      return b1 * ::std::sqrt(1.0 + t * t);
+      return b1 * ::std::sqrt(Scalar(1) + t * t);
     }
-  return a1 * ::std::sqrt(2.0);
+  return a1 * ::std::sqrt(Scalar(2));
 }
 
 
-inline double scalar_product(const VectorXd& x, const VectorXd& y)
+template<typename Scalar>
+inline Scalar scalar_product(const Matrix<Scalar, Dynamic, 1>& x, const Matrix<Scalar, Dynamic, 
+                             1>& y)
 {
-  register int i, n = x.size();
-  register double sum;
-	
-  sum = 0.0;
-  for (i = 0; i < n; i++)
-    sum += x(i) * y(i);
-  return sum;			
+  return x.dot(y);
 }
 
-void cholesky_decomposition(MatrixXd& A) 
+/* block size of the factorization kernels, and the order from which their
+   independent block columns are spread over the OpenMP threads */
+static const int cholesky_block = 64;
+static const int cholesky_parallel = 256;
+/* Bound on the steps of iterative refinement of a MixedSolver; each one 
+   gains about the digits of float over cond(G), so a problem that needs
+   more is better solved in double */
+static const int max_refinement_steps = 10;
+/* Bound on the float solves of a MixedSolver that the check in double may
+   send back with a corrected active set, before it falls back to double */
+static const int max_refinement_rounds = 4;
+
+/* Right-looking blocked Cholesky factorization A = L L^T, computed in place.
+   Each step factors a diagonal block, solves the panel below it and updates
+   the trailing lower triangle one block column at a time, so that almost all
+   the work is done by the Eigen matrix-product kernels. On exit L is stored
+   in both triangles of A, as the elimination routines expect */
+template<typename Scalar>
+void cholesky_decomposition(Matrix<Scalar, Dynamic, Dynamic>& A) 
 {
-  register int i, j, k, n = A.rows();
-  register double sum;
+  int j, k, n = A.rows();
 	
-  for (i = 0; i < n; i++)
+  for (k = 0; k < n; k += cholesky_block)
   {
-    for (j = i; j < n; j++)
+    int b = std::min(cholesky_block, n - k), r = n - k - b;
+    Ref<Matrix<Scalar, Dynamic, Dynamic> > A11 = A.block(k, k, b, b);
+    LLT<Ref<Matrix<Scalar, Dynamic, Dynamic> > > llt(A11);
+    if (llt.info() != Success)
     {
-      sum = A(i, j);
-      for (k = i - 1; k >= 0; k--)
-        sum -= A(i, k)*A(j, k);
-      if (i == j) 
-	    {
-	      if (sum <= 0.0)
-        {
-          std::ostringstream os;
-          // raise error
-          print_matrix("A", A);
-          os << "Error in cholesky decomposition, sum: " << sum;
-          throw std::logic_error(os.str());
-          exit(-1);
-        }
-	      A(i, i) = ::std::sqrt(sum);
-	    }
-      else
-        A(j, i) = sum / A(i, i);
+      std::ostringstream os;
+      // raise error
+      os << "Error in cholesky decomposition, the matrix is not positive definite "
+         << "(diagonal block at " << k << ")";
+      throw std::logic_error(os.str());
+    }
+    if (r == 0)
+      break;
+    /* A21 <- A21 L11^-T */
+    A11.template triangularView<Lower>().transpose().template solveInPlace<OnTheRight>(A.block(k + b, k, r, b));
+    /* A22 <- A22 - A21 A21^T, lower triangle only */
+#pragma omp parallel for schedule(dynamic) if (r >= cholesky_parallel)
+    for (j = k + b; j < n; j += cholesky_block)
+    {
+      int jb = std::min(cholesky_block, n - j);
+      A.block(j, j, n - j, jb).noalias() -= A.block(j, k, n - j, b) * A.block(j, k, jb, b).transpose();
     }
-    for (k = i + 1; k < n; k++)
-      A(i, k) = A(k, i);
-  } 
+  }
+  A.template triangularView<StrictlyUpper>() = A.transpose();
+}
+
+/* J = L^-T for the lower triangular Cholesky factor L. Block column c of
+   L^-1 is zero above row c, so it is the solution of the trailing triangle of
+   L against the matching columns of the identity; these solves are
+   independent of each other */
+template<typename Scalar>
+void inverse_cholesky_factor(const Matrix<Scalar, Dynamic, Dynamic>& L, Matrix<Scalar, Dynamic, Dynamic>& J)
+{
+  int c, n = L.rows();
+  
+  J.setIdentity();
+#pragma omp parallel for schedule(dynamic) if (n >= cholesky_parallel)
+  for (c = 0; c < n; c += cholesky_block)
+  {
+    int b = std::min(cholesky_block, n - c);
+    L.bottomRightCorner(n - c, n - c).template triangularView<Lower>().solveInPlace(J.block(c, c, n - c, b));
+  }
+  J.transposeInPlace();
+}
+
+/* true if every off-diagonal element of G is zero; a dense G is usually
+   rejected at its second element */
+template<typename Derived>
+bool is_diagonal(const MatrixBase<Derived>& G)
+{
+  int i, j, n = G.rows();
+
+  for (j = 0; j < n; j++)
+    for (i = 0; i < n; i++)
+      if (i != j && G(i, j) != 0.0)
+	return false;
+  return true;
 }
 
-void cholesky_solve(const MatrixXd& L, VectorXd& x, const VectorXd& b)
+template<typename Scalar>
+void cholesky_solve(const Matrix<Scalar, Dynamic, Dynamic>& L, Matrix<Scalar, Dynamic, 1>& x, 
+                    const Matrix<Scalar, Dynamic, 1>& b)
 {
   int n = L.rows();
-  VectorXd y(n);
+  Matrix<Scalar, Dynamic, 1> y(n);
 	
   /* Solve L * y = b */
   forward_elimination(L, y, b);
@@ -757,9 +1970,11 @@ void cholesky_solve(const MatrixXd& L, VectorXd& x, const VectorXd& b)
   backward_elimination(L, x, y);
 }
 
-inline void forward_elimination(const MatrixXd& L, VectorXd& y, const VectorXd& b)
+template<typename Scalar>
+inline void forward_elimination(const Matrix<Scalar, Dynamic, Dynamic>& L, Matrix<Scalar, Dynamic, 
+                                1>& y, const Matrix<Scalar, Dynamic, 1>& b)
 {
-  register int i, j, n = L.rows();
+  int i, j, n = L.rows();
 	
   y(0) = b(0) / L(0, 0);
   for (i = 1; i < n; i++)
@@ -771,9 +1986,11 @@ inline void forward_elimination(const MatrixXd& L, VectorXd& y, const VectorXd&
   }
 }
 
-inline void backward_elimination(const MatrixXd& U, VectorXd& x, const VectorXd& y)
+template<typename Scalar>
+inline void backward_elimination(const Matrix<Scalar, Dynamic, Dynamic>& U, Matrix<Scalar, Dynamic, 
+                                 1>& x, const Matrix<Scalar, Dynamic, 1>& y)
 {
-  register int i, j, n = U.rows();
+  int i, j, n = U.rows();
 	
   x(n - 1) = y(n - 1) / U(n - 1, n - 1);
   for (i = n - 2; i >= 0; i--)
@@ -785,7 +2002,8 @@ inline void backward_elimination(const MatrixXd& U, VectorXd& x, const VectorXd&
   }
 }
 
-void print_matrix(const char* name, const MatrixXd& A, int n, int m)
+template<typename Scalar>
+void print_matrix(const char* name, const Matrix<Scalar, Dynamic, Dynamic>& A, int n, int m)
 {
   std::ostringstream s;
   std::string t;
@@ -807,6 +2025,410 @@ void print_matrix(const char* name, const MatrixXd& A, int n, int m)
 	
   std::cout << t << std::endl;
 }
+
+template class BasicSolver<float>;
+template class BasicSolver<double>;
+template class BasicSolver<long double>;
+
+template<typename Scalar>
+BasicProblem<Scalar>::BasicProblem(const MatrixRef& G, const VectorRef& g0, 
+                                   const MatrixRef& CE, const VectorRef& ce0,  
+                                   const MatrixRef& CI, const VectorRef& ci0)
+  : G(G), CE(CE), CI(CI), g0(g0), ce0(ce0), ci0(ci0), 
+    factor_stale(true), start_stale(true), resumable(false)
+{ }
+
+template<typename Scalar>
+void BasicProblem<Scalar>::set_G(const MatrixRef& G)
+{
+  this->G = G;
+  factor_stale = true;
+  start_stale = true;
+}
+
+template<typename Scalar>
+void BasicProblem<Scalar>::set_g0(const VectorRef& g0)
+{
+  this->g0 = g0;
+}
+
+template<typename Scalar>
+void BasicProblem<Scalar>::set_CE(const MatrixRef& CE)
+{
+  this->CE = CE;
+  start_stale = true;
+}
+
+template<typename Scalar>
+void BasicProblem<Scalar>::set_ce0(const VectorRef& ce0)
+{
+  this->ce0 = ce0;
+}
+
+template<typename Scalar>
+void BasicProblem<Scalar>::set_CI(const MatrixRef& CI)
+{
+  /* the active set is only kept as a warm start if its indices still
+     refer to the same rows */
+  if (CI.cols() != this->CI.cols())
+    resumable = false;
+  this->CI = CI;
+  start_stale = true;
+}
+
+template<typename Scalar>
+void BasicProblem<Scalar>::set_ci(int i, const VectorRef& ci)
+{
+  if (i < 0 || i >= CI.cols() || ci.size() != CI.rows())
+  {
+    std::ostringstream msg;
+    msg << "The column " << i << " of CI is incompatible (" << ci.size() 
+	<< " elements, expecting " << CI.rows() << " and an index below " << CI.cols() << ")";
+    throw std::logic_error(msg.str());
+  }
+  CI.col(i) = ci;
+  if (is_active(i))
+    start_stale = true;
+}
+
+template<typename Scalar>
+void BasicProblem<Scalar>::set_ci0(const VectorRef& ci0)
+{
+  this->ci0 = ci0;
+}
+
+template<typename Scalar>
+void BasicProblem<Scalar>::set_bounds(const VectorRef& lb, const VectorRef& ub)
+{
+  /* adding or removing the bounds renumbers the rows after CI */
+  if (lb.size() != solver.lb.size())
+    resumable = false;
+  solver.set_bounds(lb, ub);
+}
+
+template<typename Scalar>
+void BasicProblem<Scalar>::add_constraints(const MatrixRef& CI, const VectorRef& ci0)
+{
+  int mci = this->CI.cols(), k = CI.cols();
+  if (CI.rows() != this->CI.rows() || ci0.size() != k)
+  {
+    std::ostringstream msg;
+    msg << "The constraints added are incompatible (CI is " << CI.rows() << " x " << k
+	<< " and ci0 has " << ci0.size() << ", expecting " << this->CI.rows() << " rows)";
+    throw std::logic_error(msg.str());
+  }
+  this->CI.conservativeResize(NoChange, mci + k);
+  this->CI.rightCols(k) = CI;
+  this->ci0.conservativeResize(mci + k);
+  this->ci0.tail(k) = ci0;
+  if (resumable)
+    solver.insert_rows(mci, k);
+}
+
+template<typename Scalar>
+void BasicProblem<Scalar>::rank_update(const VectorRef& v, Scalar sigma)
+{
+  /* the factor is updated in place, unless G is refactorized anyway */
+  if (!factor_stale)
+  {
+    try
+    {
+      solver.rank_update(v, sigma);
+    }
+    catch (...)
+    {
+      /* the factor may be lost: the next solve refactorizes the old G */
+      factor_stale = true;
+      throw;
+    }
+  }
+  G.noalias() += sigma * v * v.transpose();
+  start_stale = true;
+}
+
+template<typename Scalar>
+bool BasicProblem<Scalar>::is_active(int i) const
+{
+  if (!resumable)
+    return false;
+  for (int k = solver.p; k < solver.iq; k++)
+    if (solver.A(k) == i)
+      return true;
+  return false;
+}
+
+template<typename Scalar>
+Scalar BasicProblem<Scalar>::solve(VectorX& x)
+{
+  bool hot = resumable && !start_stale, warm = resumable && start_stale;
+  /* the warm start is taken before anything can change the state */
+  if (warm)
+    solver.get_active_set(active, u);
+  /* until this solve completes, it leaves no state to resume from */
+  resumable = false;
+  if (factor_stale)
+  {
+    solver.factorize(G);
+    factor_stale = false;
+  }
+  solver.resume = hot;
+  /* an empty warm start would say that no inequality is active */
+  Scalar f_value = warm ? solver.solve_factored(g0, CE, ce0, CI, ci0, x, active) 
+    : solver.solve_factored(g0, CE, ce0, CI, ci0, x);
+  start_stale = false;
+  resumable = true;
+  return f_value;
+}
+
+template class BasicProblem<float>;
+template class BasicProblem<double>;
+template class BasicProblem<long double>;
+
+MixedSolver::MixedSolver()
+  : single_ok(false), full_factorized(false), fallback(false), iter(0), steps(0)
+{ }
+
+MixedSolver::MixedSolver(int n, int p, int m)
+  : single_ok(false), full_factorized(false), fallback(false), iter(0), steps(0)
+{
+  resize(n, p, m);
+}
+
+void MixedSolver::resize(int n, int p, int m)
+{
+  single.resize(n, p, m);
+  N.resize(n, p + m);
+  b.resize(p + m);
+  lambda.resize(p + m);
+  r1.resize(n);
+  r2.resize(p + m);
+  s.resize(m);
+}
+
+double MixedSolver::solve(const MatrixXd& G, const VectorXd& g0, 
+                          const MatrixXd& CE, const VectorXd& ce0,  
+                          const MatrixXd& CI, const VectorXd& ci0, 
+                          VectorXd& x)
+{
+  factorize(G);
+  return solve_factored(g0, CE, ce0, CI, ci0, x);
+}
+
+void MixedSolver::factorize(const MatrixXd& G)
+{
+  this->G = G;
+  full_factorized = false;
+  try
+  {
+    single.factorize(G.cast<float>());
+    single_ok = true;
+  }
+  catch (std::logic_error&)
+  {
+    /* not positive definite in float: leave it to the double solver, which 
+       reports the error if G really is not */
+    single_ok = false;
+  }
+}
+
+double MixedSolver::solve_factored(const VectorXd& g0, 
+                                   const MatrixXd& CE, const VectorXd& ce0,  
+                                   const MatrixXd& CI, const VectorXd& ci0, 
+                                   VectorXd& x)
+{
+  iter = 0;
+  steps = 0;
+  fallback = false;
+  active.resize(0);
+  if (!single_ok)
+    return solve_double(g0, CE, ce0, CI, ci0, x);
+
+  g0f = g0.cast<float>();
+  CEf = CE.cast<float>();
+  ce0f = ce0.cast<float>();
+  CIf = CI.cast<float>();
+  ci0f = ci0.cast<float>();
+  for (int round = 0; ; round++)
+  {
+    float f_value;
+    try
+    {
+      if (round == 0)
+        f_value = single.solve_factored(g0f, CEf, ce0f, CIf, ci0f, xf);
+      else
+        f_value = single.solve_factored(g0f, CEf, ce0f, CIf, ci0f, xf, warm);
+    }
+    catch (std::logic_error&)
+    {
+      /* e.g. equalities dependent up to float rounding */
+      return solve_double(g0, CE, ce0, CI, ci0, x);
+    }
+    iter += single.iterations();
+    single.get_active_set(active, uf);
+    /* an infeasible problem in float may only be badly rounded */
+    if (f_value == std::numeric_limits<float>::infinity() || 
+        !refine(g0, CE, ce0, CI, ci0, x))
+      return solve_double(g0, CE, ce0, CI, ci0, x);
+    if (verify(CI, ci0, x))
+      break;
+    if (round == max_refinement_rounds)
+      return solve_double(g0, CE, ce0, CI, ci0, x);
+  }
+
+  r1.noalias() = G * x;
+  return 0.5 * x.dot(r1) + g0.dot(x);
+}
+
+bool MixedSolver::refine(const VectorXd& g0, 
+                         const MatrixXd& CE, const VectorXd& ce0,  
+                         const MatrixXd& CI, const VectorXd& ci0, 
+                         VectorXd& x)
+{
+  const double eps = std::numeric_limits<double>::epsilon();
+  int n = G.rows(), p = CE.cols(), k = active.size(), q = p + k;
+  int i;
+
+  /* the KKT system of the active set, G x + g0 = N lambda and 
+     N^T x + b = 0, with the active inequalities as equalities */
+  N.resize(n, q);
+  b.resize(q);
+  N.leftCols(p) = CE;
+  b.head(p) = ce0;
+  for (i = 0; i < k; i++)
+  {
+    N.col(p + i) = CI.col(active(i));
+    b(p + i) = ci0(active(i));
+  }
+
+  /* a correction solves G dx - N dl = r1, N^T dx = r2. The float solver
+     ended with J^T G J = I and J^T N = [R; 0], hence dx = J v with
+     R^T v1 = r2, v2 = J2^T r1 and R dl = v1 - J1^T r1: two products by J
+     and two triangular solves of order q, with no new factorization. 
+     After the direct path J = L^-T Q is not built: Q is held as the p 
+     reflectors of W, and R is the top of W (see equality_solution()) */
+  if (single.iq != q)
+    return false;
+  const bool direct = single.direct;
+  const MatrixXf& J = single.J;
+  const MatrixXf& R = direct ? single.W : single.R;
+
+  /* start from the float solution */
+  x = xf.cast<double>();
+  lambda = single.u.head(q).cast<double>();
+  double correction, previous = std::numeric_limits<double>::infinity();
+  bool converged = false;
+  r2.resize(q);
+  for (int step = 0; step < max_refinement_steps; step++)
+  {
+    r1 = -g0;
+    r1.noalias() -= G * x;
+    r1.noalias() += N * lambda;
+    r2 = -b;
+    r2.noalias() -= N.transpose() * x;
+    rf = r1.cast<float>();
+    if (direct)
+    {
+      v = rf;
+      single.L.triangularView<Lower>().solveInPlace(v);
+      for (i = 0; i < q; i++)
+        v.tail(n - i).applyHouseholderOnTheLeft(single.W.col(i).tail(n - i - 1), single.W_h(i), single.W_work.data());
+    }
+    else
+      v.noalias() = J.transpose() * rf;
+    v1 = r2.cast<float>();
+    R.topLeftCorner(q, q).transpose().triangularView<Lower>().solveInPlace(v1);
+    dl = v1 - v.head(q);
+    R.topLeftCorner(q, q).triangularView<Upper>().solveInPlace(dl);
+    v.head(q) = v1;
+    if (direct)
+    {
+      rf = v;
+      for (i = q - 1; i >= 0; i--)
+        rf.tail(n - i).applyHouseholderOnTheLeft(single.W.col(i).tail(n - i - 1), single.W_h(i), single.W_work.data());
+      single.L.triangularView<Lower>().transpose().solveInPlace(rf);
+    }
+    else
+      rf.noalias() = J * v;
+    x += rf.cast<double>();
+    lambda += dl.cast<double>();
+    steps++;
+
+    correction = std::sqrt(double(rf.squaredNorm()) + double(dl.squaredNorm()));
+    double size = std::sqrt(x.squaredNorm() + lambda.squaredNorm());
+    if (correction <= 4.0 * eps * size)
+    {
+      converged = true;
+      break;
+    }
+    /* stagnation: either the rounding level of double is reached, or float
+       is too coarse for cond(G) and the iteration does not contract */
+    if (correction > 0.5 * previous)
+    {
+      converged = correction <= std::sqrt(eps) * size;
+      break;
+    }
+    previous = correction;
+  }
+  if (!converged)
+    return false;
+
+  u = lambda.tail(k);
+  return true;
+}
+
+bool MixedSolver::verify(const MatrixXd& CI, const VectorXd& ci0, const VectorXd& x)
+{
+  /* the same tolerance as the stopping test of the double solver on the 
+     infeasibility, and on the sign of the multipliers */
+  const double eps = std::numeric_limits<double>::epsilon();
+  int m = CI.cols(), k = active.size(), i, l;
+  double tolerance = (m + 1) * eps * double(single.c1) * double(single.c2) * 100.0;
+  double u_tolerance = tolerance * (1.0 + (k > 0 ? u.cwiseAbs().maxCoeff() : 0.0));
+  s.noalias() = CI.transpose() * x;
+  s += ci0;
+
+  /* the float active set is rejected if some row is violated in double, 
+     or if some multiplier is negative; the next round is warm started from
+     it, less the rows of negative multiplier and with the violated rows */
+  warm.resize(k + m);
+  l = 0;
+  for (i = 0; i < k; i++)
+    if (u(i) >= -u_tolerance)
+      warm(l++) = active(i);
+  bool optimal = l == k;
+  for (i = 0; i < m; i++)
+    if (s(i) < -tolerance)
+    {
+      warm(l++) = i;
+      optimal = false;
+    }
+  warm.conservativeResize(l);
+  return optimal;
+}
+
+double MixedSolver::solve_double(const VectorXd& g0, 
+                                 const MatrixXd& CE, const VectorXd& ce0,  
+                                 const MatrixXd& CI, const VectorXd& ci0, 
+                                 VectorXd& x)
+{
+  fallback = true;
+  if (!full_factorized)
+  {
+    full.factorize(G);
+    full_factorized = true;
+  }
+  double f_value = full.solve_factored(g0, CE, ce0, CI, ci0, x, active);
+  iter += full.iterations();
+  full.get_active_set(active, u);
+  return f_value;
+}
+
+void MixedSolver::get_active_set(VectorXi& active, VectorXd& u) const
+{
+  active = this->active;
+  u = this->u;
+}
+
 }  /*
 template<typename T>
 void print_vector(const char* name, const ublas::vector<T>& v, int n)
@@ -34,10 +34,9 @@ s.t.
   1. pay attention in setting up the vectors ce0 and ci0. 
 	   If the constraints of your problem are specified in the form 
 	   A^T x = b and C^T x >= d, then you should set ce0 = -b and ci0 = -d.  
-  2. The matrix G is modified within the function since it is used to compute
-     the G = L^T L cholesky factorization for further computations inside the function. 
-     If you need the original matrix G you should make a copy of it and pass the copy
-     to the function.
+  2. The G = L^T L cholesky factorization is computed on a copy of G, which is
+     not modified. To reuse the factorization across problems that share G,
+     use QP::Solver::factorize() and QP::Solver::solve_factored().
     
  Author: Luca Di Gaspero
   			 DIEGM - University of Udine, Italy
@@ -77,14 +76,514 @@ along with QuadProg++. If not, see <http://www.gnu.org/licenses/>.
 					   //#include <boost/numeric/ublas/vector.hpp>
 					   //#include <boost/numeric/ublas/matrix.hpp>
 #include <Eigen/Eigen>
+#include <vector>
 namespace QP {
 
   //namespace ublas = boost::numeric::ublas;
   using namespace Eigen;
-  double solve_quadprog(MatrixXd& G, VectorXd& g0, 
+  double solve_quadprog(const Ref<const MatrixXd>& G, const Ref<const VectorXd>& g0, 
+			const Ref<const MatrixXd>& CE, const Ref<const VectorXd>& ce0,  
+			const Ref<const MatrixXd>& CI, const Ref<const VectorXd>& ci0, 
+			VectorXd& x);
+  /* Sparse constraints: column i of CE (CI) holds constraint i, so that 
+     evaluating the constraints and extracting a column only touch nonzeros */
+  double solve_quadprog(const Ref<const MatrixXd>& G, const Ref<const VectorXd>& g0, 
+			const SparseMatrix<double>& CE, const Ref<const VectorXd>& ce0,  
+			const SparseMatrix<double>& CI, const Ref<const VectorXd>& ci0, 
+			VectorXd& x);
+  /* With simple bounds lb <= x <= ub on the variables, see Solver::set_bounds() */
+  double solve_quadprog(const Ref<const MatrixXd>& G, const Ref<const VectorXd>& g0, 
+			const Ref<const MatrixXd>& CE, const Ref<const VectorXd>& ce0,  
+			const Ref<const MatrixXd>& CI, const Ref<const VectorXd>& ci0, 
+			const Ref<const VectorXd>& lb, const Ref<const VectorXd>& ub, 
+			VectorXd& x);
+  /* With two-sided inequalities cl <= CI^T x <= cu, see Solver::solve() */
+  double solve_quadprog(const Ref<const MatrixXd>& G, const Ref<const VectorXd>& g0, 
+			const Ref<const MatrixXd>& CE, const Ref<const VectorXd>& ce0,  
+			const Ref<const MatrixXd>& CI, const Ref<const VectorXd>& cl, const Ref<const VectorXd>& cu, 
+			VectorXd& x);
+
+  /* Direction of inequalities given in row form, see Solver::solve_rows() */
+  enum Sense
+  {
+    GREATER_EQUAL = 0, /* A x >= b */
+    LESS_EQUAL = 1 /* A x <= b */
+  };
+
+  /*
+   Stateful version of solve_quadprog(). The solver owns all of the work
+   matrices and vectors used by the method, so once it has been sized for a
+   problem of dimensions (n, p, m) repeated calls to solve() with the same
+   dimensions do not perform any heap allocation.
+   The workspace is resized automatically if solve() is called with different
+   dimensions.
+   The solver is a template on the scalar type, which also sets the 
+   tolerances (they are multiples of its epsilon); it is compiled for float, 
+   double and long double, see the Solver typedefs below. Single precision 
+   halves the memory traffic and doubles the SIMD width of the kernels, but 
+   is only accurate enough for well conditioned problems.
+   */
+  template<typename Scalar>
+  class BasicSolver
+  {
+  public:
+    typedef Matrix<Scalar, Dynamic, Dynamic> MatrixX;
+    typedef Matrix<Scalar, Dynamic, 1> VectorX;
+    typedef SparseMatrix<Scalar> SparseMatrixX;
+    typedef Matrix<Scalar, Dynamic, Dynamic, RowMajor> RowMatrixX;
+    /* Dense inputs are taken by Eigen::Ref, which binds without a copy to a
+       MatrixX, to a Map of external storage or to a block of columns; any
+       other expression (a product, -A, a row-major matrix) is evaluated into
+       a temporary first */
+    typedef Ref<const MatrixX> MatrixRef;
+    typedef Ref<const VectorX> VectorRef;
+    typedef Ref<const RowMatrixX> RowMatrixRef;
+
+    BasicSolver();
+    BasicSolver(int n, int p, int m);
+
+    void resize(int n, int p, int m);
+
+    Scalar solve(const MatrixRef& G, const VectorRef& g0, 
+		 const MatrixRef& CE, const VectorRef& ce0,  
+		 const MatrixRef& CI, const VectorRef& ci0, 
+		 VectorX& x);
+
+    /*
+     Warm start: the inequality constraints listed in active (indices into
+     the columns of CI, e.g. as returned by get_active_set() on a previous
+     solve) are factored into R and J up front, together with the equality
+     constraints. Constraints that turn out to be linearly dependent or
+     to have a negative multiplier are dropped before iterating, so any
+     guess is acceptable; a good one saves most of the iterations. An 
+     empty active set says that no inequality is active: x is then taken
+     from one solve of the KKT system of the equalities, and the iterations
+     only run if it violates an inequality or a bound.
+     */
+    Scalar solve(const MatrixRef& G, const VectorRef& g0, 
+		 const MatrixRef& CE, const VectorRef& ce0,  
+		 const MatrixRef& CI, const VectorRef& ci0, 
+		 VectorX& x, const VectorXi& active);
+
+    /* The same, with sparse constraint matrices (see solve_quadprog()) */
+    Scalar solve(const MatrixRef& G, const VectorRef& g0, 
+		 const SparseMatrixX& CE, const VectorRef& ce0,  
+		 const SparseMatrixX& CI, const VectorRef& ci0, 
+		 VectorX& x);
+    Scalar solve(const MatrixRef& G, const VectorRef& g0, 
+		 const SparseMatrixX& CE, const VectorRef& ce0,  
+		 const SparseMatrixX& CI, const VectorRef& ci0, 
+		 VectorX& x, const VectorXi& active);
+
+    /*
+     Two-sided inequalities cl <= CI^T x <= cu in place of CI^T x + ci0 >= 0,
+     without duplicating CI. A row is active at one end at a time, and an
+     infinite cl(i) or cu(i) leaves that end open. In get_active_set() and
+     in warm starts row i is written i when it is active at cl(i), and
+     -i - 1 when it is active at cu(i). (These are not overloads of solve(),
+     which would be ambiguous with the warm start versions.)
+     */
+    Scalar solve_ranged(const MatrixRef& G, const VectorRef& g0, 
+			const MatrixRef& CE, const VectorRef& ce0,  
+			const MatrixRef& CI, const VectorRef& cl, const VectorRef& cu, 
+			VectorX& x);
+    Scalar solve_ranged(const MatrixRef& G, const VectorRef& g0, 
+			const MatrixRef& CE, const VectorRef& ce0,  
+			const MatrixRef& CI, const VectorRef& cl, const VectorRef& cu, 
+			VectorX& x, const VectorXi& active);
+    Scalar solve_ranged(const MatrixRef& G, const VectorRef& g0, 
+			const SparseMatrixX& CE, const VectorRef& ce0,  
+			const SparseMatrixX& CI, const VectorRef& cl, const VectorRef& cu, 
+			VectorX& x);
+    Scalar solve_ranged(const MatrixRef& G, const VectorRef& g0, 
+			const SparseMatrixX& CE, const VectorRef& ce0,  
+			const SparseMatrixX& CI, const VectorRef& cl, const VectorRef& cu, 
+			VectorX& x, const VectorXi& active);
+
+    /*
+     Factor-once use: factorize() computes the Cholesky factor of G and the
+     initial J = L^-T, which are kept by the solver, and solve_factored()
+     reuses them. This skips the O(n^3) preprocessing when
+     only g0, the constraints or their offsets change between solves.
+     G itself is not modified. A diagonal G, such as the identity, is 
+     detected and factorized in O(n^2).
+     */
+    void factorize(const MatrixRef& G);
+    /*
+     Changes the factorized G to G + sigma v v^T, in O(n^2) rather than the 
+     O(n^3) of factorize(): a rank-one update of the Cholesky factor, and
+     J0 multiplied by a rank-one correction of the identity. A BFGS step
+     is an update followed by a downdate (sigma < 0). A downdate that would
+     leave G not positive definite throws: before any change if it is 
+     clearly so, otherwise G has to be factorized again.
+     */
+    void rank_update(const VectorRef& v, Scalar sigma);
+
+    Scalar solve_factored(const VectorRef& g0, 
+			  const MatrixRef& CE, const VectorRef& ce0,  
+			  const MatrixRef& CI, const VectorRef& ci0, 
+			  VectorX& x);
+    Scalar solve_factored(const VectorRef& g0, 
+			  const MatrixRef& CE, const VectorRef& ce0,  
+			  const MatrixRef& CI, const VectorRef& ci0, 
+			  VectorX& x, const VectorXi& active);
+    Scalar solve_factored(const VectorRef& g0, 
+			  const SparseMatrixX& CE, const VectorRef& ce0,  
+			  const SparseMatrixX& CI, const VectorRef& ci0, 
+			  VectorX& x);
+    Scalar solve_factored(const VectorRef& g0, 
+			  const SparseMatrixX& CE, const VectorRef& ce0,  
+			  const SparseMatrixX& CI, const VectorRef& ci0, 
+			  VectorX& x, const VectorXi& active);
+    Scalar solve_factored_ranged(const VectorRef& g0, 
+				 const MatrixRef& CE, const VectorRef& ce0,  
+				 const MatrixRef& CI, const VectorRef& cl, const VectorRef& cu, 
+				 VectorX& x);
+    Scalar solve_factored_ranged(const VectorRef& g0, 
+				 const MatrixRef& CE, const VectorRef& ce0,  
+				 const MatrixRef& CI, const VectorRef& cl, const VectorRef& cu, 
+				 VectorX& x, const VectorXi& active);
+    Scalar solve_factored_ranged(const VectorRef& g0, 
+				 const SparseMatrixX& CE, const VectorRef& ce0,  
+				 const SparseMatrixX& CI, const VectorRef& cl, const VectorRef& cu, 
+				 VectorX& x);
+    Scalar solve_factored_ranged(const VectorRef& g0, 
+				 const SparseMatrixX& CE, const VectorRef& ce0,  
+				 const SparseMatrixX& CI, const VectorRef& cl, const VectorRef& cu, 
+				 VectorX& x, const VectorXi& active);
+
+    /*
+     Constraints in row form, as modelling code usually holds them: 
+     Aeq x = beq, and Ain x <= bin (sense LESS_EQUAL) or Ain x >= bin 
+     (GREATER_EQUAL), with one row per constraint. Row-major Aeq and Ain are
+     the transposes of the CE and CI of solve() and are used in place; the 
+     sense selects the open end of a two-sided row, so Ain is not negated.
+     Row i of Ain is inequality i of get_active_set(), written as for
+     solve_ranged(): i for GREATER_EQUAL, where the row is active at its
+     lower end, and -i - 1 for LESS_EQUAL, where it is active at bin(i) as
+     its upper end.
+     */
+    Scalar solve_rows(const MatrixRef& G, const VectorRef& g0, 
+		      const RowMatrixRef& Aeq, const VectorRef& beq,  
+		      const RowMatrixRef& Ain, const VectorRef& bin, Sense sense, 
+		      VectorX& x);
+    Scalar solve_factored_rows(const VectorRef& g0, 
+			       const RowMatrixRef& Aeq, const VectorRef& beq,  
+			       const RowMatrixRef& Ain, const VectorRef& bin, Sense sense, 
+			       VectorX& x);
+
+    /*
+     The same problem as solve(), with the equality constraints eliminated
+     first: a QR decomposition of CE gives a particular solution x0 of 
+     CE^T x + ce0 = 0 and a basis Z of the null space of CE^T, and the
+     method runs on x = x0 + Z y, with n - p unknowns and no equality. 
+     Every iteration then works on (n - p) x (n - p) matrices, which pays
+     for the O(n^2 p + n m p) reduction Z^T G Z and Z^T CI only when p is
+     a large part of n: up to p = 0.3 n it is no faster than solve(), and
+     with few equalities it is slower (1.5x at n = 150, p = 3). The bounds 
+     become dense rows Z^T, so they lose the O(1) checks of set_bounds(). 
+     The active set keeps the numbering of solve(). The reduced problem has
+     a workspace of its own, so that alternating with solve() does not 
+     allocate.
+     */
+    Scalar solve_nullspace(const MatrixRef& G, const VectorRef& g0, 
+			   const MatrixRef& CE, const VectorRef& ce0,  
+			   const MatrixRef& CI, const VectorRef& ci0, 
+			   VectorX& x);
+
+    /*
+     Constrained least squares: minimizes 1/2 ||A x - b||^2 subject to the
+     constraints of solve(), for A with at least as many rows as columns
+     and of full column rank. The factor of G = A^T A is taken from a QR 
+     decomposition of A, R^T R, so G is never formed and the condition
+     number of A is not squared. Returns 1/2 ||A x - b||^2.
+     factorize_least_squares() alone keeps that factor for solve_factored(),
+     with g0 = -A^T b.
+     */
+    Scalar solve_least_squares(const MatrixRef& A, const VectorRef& b, 
+			       const MatrixRef& CE, const VectorRef& ce0,  
+			       const MatrixRef& CI, const VectorRef& ci0, 
+			       VectorX& x);
+    void factorize_least_squares(const MatrixRef& A);
+
+    /*
+     Simple bounds lb <= x <= ub, used by the following solves until they
+     are changed; empty vectors remove them. They are kept apart from CI:
+     checking a bound is O(1), and adding one to the active set just takes
+     a row of J. Each bound is a two-sided row, numbered m + k for x(k), 
+     where m is the number of columns of CI (see the two-sided solve()).
+     */
+    void set_bounds(const VectorRef& lb, const VectorRef& ub);
+
+    /* The inequality constraints active at the last solution, and their
+       Lagrange multipliers; a row active at its upper end is written -i - 1 */
+    void get_active_set(VectorXi& active, VectorX& u) const;
+    /* Number of iterations of the last solve */
+    int iterations() const { return iter; }
+
+  private:
+    /* MixedSolver refines with the J and R of its single precision solver */
+    friend class MixedSolver;
+    /* BasicProblem resumes from the state of the last solve */
+    template<typename> friend class BasicProblem;
+
+    /* the method itself, for dense or sparse constraint matrices; the
+       inequalities are b0 <= CI^T x <= b1 if ranged, CI^T x + b0 >= 0 if not,
+       and active is a warm start if warm, even an empty one */
+    template<typename MatrixE, typename MatrixI>
+    Scalar solve_factored_impl(const VectorRef& g0, 
+			       const MatrixE& CE, const VectorRef& ce0,  
+			       const MatrixI& CI, const VectorRef& b0, const VectorRef& b1, 
+			       bool ranged, VectorX& x, bool warm, const VectorXi& active);
+    /* the factor of A^T A from the QR decomposition of A, kept in QR and h
+       as the reflectors and their coefficients */
+    void factorize_qr(const MatrixRef& A, MatrixX& QR, VectorX& h);
+    template<typename MatrixI>
+    Scalar add_active_set(const VectorRef& g0, const VectorRef& ce0,
+			  const MatrixI& CI, const VectorXi& active, 
+			  VectorX& x, Scalar& R_norm);
+    template<typename MatrixE>
+    Scalar equality_solution(const VectorRef& g0, const MatrixE& CE, 
+			     const VectorRef& ce0, VectorX& x);
+    Scalar active_set_solution(const VectorRef& g0, const VectorRef& ce0,
+			       VectorX& x);
+    Scalar dual_feasible_solution(const VectorRef& g0, const VectorRef& ce0,
+				  VectorX& x);
+    Scalar resume_active_set(const VectorRef& g0, const VectorRef& ce0,
+			     VectorX& x, Scalar& R_norm);
+    /* makes room for k rows inserted after the first mci ones, keeping the
+       state of the last solve */
+    void insert_rows(int mci, int k);
+
+    /* m counts the bounds too, as n rows after the columns of CI */
+    int n, p, m;
+    int iq, iter;
+    /* factorization of G: L holds the Cholesky factor (both triangles), 
+       J0 = L^-T, c1 * c2 is an estimate of cond(G); both are diagonal if
+       G is. After rank_update(), J0 is only a basis with J0^T G J0 = I, 
+       which is all the method needs */
+    bool factorized, diagonal;
+    /* set by solve_least_squares(): the x passed to the solve is already the
+       unconstrained minimizer */
+    bool x_given;
+    /* set by BasicProblem: the next solve starts from the J, R and active 
+       set left by the last one, instead of J0 */
+    bool resume;
+    /* J and R were not built for the last active set: the last solve had
+       no inequality and took the direct path, or rejected a row with
+       lower(i) > upper(i) */
+    bool direct;
+    /* the last solve was solve_nullspace(), whose active set is that of
+       reduced[0] */
+    bool nullspace;
+    MatrixX L, J0;
+    Scalar c1, c2;
+    VectorX lb, ub;
+    /* the offsets of solve_factored_rows(): -beq, and the open ends of the
+       rows of Ain */
+    VectorX row_ce0, row_open;
+    /* every inequality is a row lower(i) <= v(i) <= upper(i); side(i) is +1
+       if its lower end is the active (or violated) one, -1 for the upper end */
+    VectorX lower, upper;
+    VectorXi side;
+    MatrixX R, J;
+    /* the QR decomposition, in place, of L^-1 CE for equality_solution() or
+       of CE for solve_nullspace(), with its Householder coefficients and 
+       workspace */
+    MatrixX W;
+    VectorX W_h, W_work;
+    /* solve_nullspace(): Q^T G Q, Q^T (CI I), Q^T g0 and the ranges of the
+       reduced problem, x0 and its solution y, and the solver it runs on, 
+       created on first use (a vector, which can hold the incomplete type,
+       keeps the solver copyable) */
+    MatrixX QG, QC;
+    VectorX gq, yl, yu, x0, y;
+    std::vector<BasicSolver> reduced;
+    VectorX s, z, r, d, np, u, x_old, u_old;
+    VectorXi A, A_old, iai;
+    std::vector<bool> iaexcl;
+  };
+
+  typedef BasicSolver<double> Solver;
+  typedef BasicSolver<float> Solverf;
+  typedef BasicSolver<long double> Solverl;
+
+  /*
+   A problem kept between solves, for a QP re-solved with a few changes 
+   each time, as in model predictive control where only g0 and the right
+   hand sides move. The setters record what changed, and solve() only 
+   redoes what that invalidates:
+   - g0, ce0, ci0 or the values of the bounds: the solve resumes from the
+     J, R and active set of the last one, which hold the factorization and
+     the equality constraints; x and the multipliers are recomputed for
+     that set, and the iterations go on from there. 
+   - a column of CI that is not active: the same.
+   - CE, or an active column of CI: the active set is rebuilt from J0, 
+     warm started from the last one.
+   - G: it is factorized again, then warm started.
+   The constraints are CE^T x + ce0 = 0 and CI^T x + ci0 >= 0, as in
+   Solver::solve(), and the bounds of set_bounds().
+   */
+  template<typename Scalar>
+  class BasicProblem
+  {
+  public:
+    typedef typename BasicSolver<Scalar>::MatrixX MatrixX;
+    typedef typename BasicSolver<Scalar>::VectorX VectorX;
+    typedef typename BasicSolver<Scalar>::MatrixRef MatrixRef;
+    typedef typename BasicSolver<Scalar>::VectorRef VectorRef;
+
+    BasicProblem(const MatrixRef& G, const VectorRef& g0, 
+		 const MatrixRef& CE, const VectorRef& ce0,  
+		 const MatrixRef& CI, const VectorRef& ci0);
+
+    void set_G(const MatrixRef& G);
+    void set_g0(const VectorRef& g0);
+    void set_CE(const MatrixRef& CE);
+    void set_ce0(const VectorRef& ce0);
+    void set_CI(const MatrixRef& CI);
+    /* replaces column i of CI, that is inequality i */
+    void set_ci(int i, const VectorRef& ci);
+    void set_ci0(const VectorRef& ci0);
+    /* see Solver::set_bounds() */
+    void set_bounds(const VectorRef& lb, const VectorRef& ub);
+    /* G + sigma v v^T, see Solver::rank_update() */
+    void rank_update(const VectorRef& v, Scalar sigma);
+    /* 
+     Appends the columns of CI and the elements of ci0 as new inequalities,
+     numbered after the current ones, as the cuts of a cutting-plane loop.
+     The solve that follows resumes from the last active set, which stays
+     dual feasible: only the new rows that are violated are added to it.
+     */
+    void add_constraints(const MatrixRef& CI, const VectorRef& ci0);
+
+    Scalar solve(VectorX& x);
+
+    void get_active_set(VectorXi& active, VectorX& u) const { solver.get_active_set(active, u); }
+    int iterations() const { return solver.iterations(); }
+
+  private:
+    /* true if inequality i is in the active set of the last solve */
+    bool is_active(int i) const;
+
+    MatrixX G, CE, CI;
+    VectorX g0, ce0, ci0;
+    BasicSolver<Scalar> solver;
+    /* what the changes since the last solve invalidate: the factor of G, 
+       the J and R of the active set; resumable is false when there is no 
+       active set to start from at all */
+    bool factor_stale, start_stale, resumable;
+    VectorXi active;
+    VectorX u;
+  };
+
+  typedef BasicProblem<double> Problem;
+
+  /*
+   Mixed precision: the factorization of G and the active-set iterations
+   (J, R and their Givens updates) run in single precision, in a Solverf. 
+   x and the Lagrange multipliers of the final active set are then 
+   recomputed in double, by iterative refinement of the KKT system of that
+   active set: the residuals are formed in double, the corrections are 
+   solved with the float factors.
+   The refined solution is checked in double, for the feasibility of every
+   inequality and the sign of the multipliers: the stopping test of float
+   is coarse, and its iterations may end on a wrong active set. The float
+   solve is then warm started again, from the active set less the rows of
+   negative multiplier and with the violated rows. When that does not 
+   settle in a few rounds, or G is too ill conditioned for float to 
+   factorize or to refine with, the problem is solved by a double Solver, 
+   warm started from the float active set; fell_back() tells when that 
+   happened.
+   Only dense constraints CI^T x + ci0 >= 0 are supported.
+   */
+  class MixedSolver
+  {
+  public:
+    MixedSolver();
+    MixedSolver(int n, int p, int m);
+
+    void resize(int n, int p, int m);
+
+    double solve(const MatrixXd& G, const VectorXd& g0, 
+		 const MatrixXd& CE, const VectorXd& ce0,  
+		 const MatrixXd& CI, const VectorXd& ci0, 
+		 VectorXd& x);
+
+    /* Factor-once use, as for Solver; G is kept in double for the 
+       residuals of the refinement */
+    void factorize(const MatrixXd& G);
+    double solve_factored(const VectorXd& g0, 
+			  const MatrixXd& CE, const VectorXd& ce0,  
+			  const MatrixXd& CI, const VectorXd& ci0, 
+			  VectorXd& x);
+
+    /* As Solver::get_active_set(), with the refined multipliers */
+    void get_active_set(VectorXi& active, VectorXd& u) const;
+    /* Number of iterations of the last solve, in single precision and 
+       then in double if it fell back */
+    int iterations() const { return iter; }
+    /* Number of refinement steps of the last solve */
+    int refinement_steps() const { return steps; }
+    /* Whether the last solve was redone in double */
+    bool fell_back() const { return fallback; }
+
+  private:
+    bool refine(const VectorXd& g0, 
+		const MatrixXd& CE, const VectorXd& ce0,  
+		const MatrixXd& CI, const VectorXd& ci0, 
+		VectorXd& x);
+    bool verify(const MatrixXd& CI, const VectorXd& ci0, const VectorXd& x);
+    double solve_double(const VectorXd& g0, 
 			const MatrixXd& CE, const VectorXd& ce0,  
 			const MatrixXd& CI, const VectorXd& ci0, 
 			VectorXd& x);
+
+    Solverf single;
+    Solver full;
+    MatrixXd G;
+    /* single_ok is false if G could not be factorized in float; full is
+       only factorized on the first fall back */
+    bool single_ok, full_factorized, fallback;
+    int iter, steps;
+    VectorXi active, warm;
+    VectorXd u;
+    /* the problem in float, and the refinement workspace: N holds the 
+       active constraints, lambda their multipliers */
+    MatrixXf CEf, CIf;
+    VectorXf g0f, ce0f, ci0f, xf, uf, rf, v, v1, dl;
+    MatrixXd N;
+    VectorXd b, lambda, r1, r2, s;
+  };
+
+  /* Outcome of each problem of a batch solve */
+  enum Status
+  {
+    SOLVED = 0,
+    INFEASIBLE = 1,
+    FAILED = 2 /* e.g. G not positive definite or dependent equalities */
+  };
+
+  /*
+   Solves N independent problems of the same dimensions, spread over the
+   available cores with OpenMP. Problem k is given by column k of g0, ce0 and
+   ci0, and its solution is written to column k of x, its objective to
+   f_value(k) and its outcome to status(k).
+   G, CE and CI hold either a single matrix, shared by all the problems, or
+   one matrix per problem. A shared G is factorized only once.
+   Each thread solves with its own Solver, so the only allocations are the
+   per-thread workspaces. num_threads = 0 uses the OpenMP default.
+   */
+  void solve_quadprog_batch(const std::vector<MatrixXd>& G, const MatrixXd& g0, 
+			    const std::vector<MatrixXd>& CE, const MatrixXd& ce0,  
+			    const std::vector<MatrixXd>& CI, const MatrixXd& ci0, 
+			    MatrixXd& x, VectorXd& f_value, VectorXi& status,
+			    int num_threads = 0);
+  void solve_quadprog_batch(const MatrixXd& G, const MatrixXd& g0, 
+			    const MatrixXd& CE, const MatrixXd& ce0,  
+			    const MatrixXd& CI, const MatrixXd& ci0, 
+			    MatrixXd& x, VectorXd& f_value, VectorXi& status,
+			    int num_threads = 0);
 }
 
 #endif // #define _UQUADPROGPP
@@ -31,6 +31,9 @@
 
  */
 
+#ifndef _EIGENQPSTATIC
+#define _EIGENQPSTATIC
+
 #include <iostream>
 #include <algorithm>
 #include <cmath>
@@ -49,105 +52,218 @@ using std::vector;
 #define EVECd(n) Matrix<double, n, 1>
 #define EMATi(n, m) Matrix<int, n, m>
 #define EVECi(n) Matrix<int, n, 1>
+/* the same, for the Scalar type of the enclosing template */
+#define EMAT(n, m) Matrix<Scalar, n, m>
+#define EVEC(n) Matrix<Scalar, n, 1>
 //#define EROWS(X) X::RowsAtCompileTime
 //#define ECOLS(X) X::ColsAtCompileTime
 
-// TODO: Make some sort of workspace just like CVXGEN... Later though?
-
 namespace QP
 {
 
 // The Solving function, implementing the Goldfarb-Idnani method
 
-template<typename Scalar, int n, int m>
-inline void print_stuff(const char *name, const Matrix<Scalar, n, m> &X)
+template<typename Derived>
+inline void print_stuff(const char *name, const MatrixBase<Derived> &X)
 {
 	std::cout << name << " = \n" << X << "\n";
 }
 
 
 
-inline double distance(double a, double b)
+template<typename Scalar>
+inline Scalar distance(Scalar a, Scalar b)
 {
-	register double a1, b1, t;
-	a1 = fabs(a);
-	b1 = fabs(b);
+	Scalar a1, b1, t;
+	a1 = std::abs(a);
+	b1 = std::abs(b);
 	if (a1 > b1) 
 	{
 		t = (b1 / a1);
-		return a1 * ::std::sqrt(1.0 + t * t);
+		return a1 * ::std::sqrt(Scalar(1) + t * t);
 	}
 	else
 		if (b1 > a1)
 		{
 			t = (a1 / b1);
-			return b1 * ::std::sqrt(1.0 + t * t);
+			return b1 * ::std::sqrt(Scalar(1) + t * t);
 		}
-	return a1 * ::std::sqrt(2.0);
+	return a1 * ::std::sqrt(Scalar(2));
 }
 
-template<int n>
-inline void compute_d(EVECd(n)& d, const EMATd(n, n)& J, const EVECd(n)& np)
+/* Slack factor of the stopping test on the total infeasibility psi, which is
+   m * eps * cond(G) * margin. Single precision cannot afford the factor of
+   100 used for double: it would accept violations of a few percent. */
+template<typename Scalar>
+inline Scalar infeasibility_margin()
 {
-	register int i, j;
-	register double sum;
+	return Scalar(100);
+}
+
+template<>
+inline float infeasibility_margin<float>()
+{
+	return 1.0f;
+}
 
+/*
+ The helpers below are templates on the matrix types of the workspace, so
+ that they serve both the fixed-size Workspace and the BoundedWorkspace. n is
+ read from the matrices: with fixed sizes it is still a compile-time constant.
+ */
+template<typename MatN, typename VecN>
+inline void compute_d(VecN& d, const MatN& J, const VecN& np)
+{
 	/* compute d = H^T * np */
-	for (i = 0; i < n; i++)
+	d.noalias() = J.transpose() * np;
+}
+
+/* np = column i of CI */
+template<typename MatCI, typename VecN>
+inline void constraint_column(VecN& np, const MatCI& CI, int i)
+{
+	np = CI.col(i);
+}
+
+/* a CI with no column at compile time (m = 0) has none to read, and Eigen 
+   sizes its blocks 0 x 0: the solve returns before it gets here */
+template<typename Scalar, int n, int Options, int MaxRows, int MaxCols, typename VecN>
+inline void constraint_column(VecN& np, const Matrix<Scalar, n, 0, Options, MaxRows, MaxCols>& CI, int i)
+{
+}
+
+/* Applies a Givens rotation to the columns x and y of J: x' = cc x + ss y and
+   y' = xny (x + x') - y. With n known at compile time the loop is unrolled
+   into packed SIMD arithmetic; n = Dynamic takes the length from size */
+template<int n, typename Scalar>
+inline void apply_givens(Scalar* __restrict x, Scalar* __restrict y, int size, Scalar cc, Scalar ss, Scalar xny)
+{
+	const int len = n == Dynamic ? size : n;
+#pragma omp simd
+	for (int k = 0; k < len; k++)
 	{
-		sum = 0.0;
-		for (j = 0; j < n; j++)
-			sum += J(j, i) * np(j);
-		d(i) = sum;
+		Scalar t1 = x[k], t2 = y[k];
+		x[k] = t1 * cc + t2 * ss;
+		y[k] = xny * (t1 + x[k]) - t2;
 	}
 }
 
+/*
+ For small n known at compile time, the loops over the active set in
+ update_z, update_r and add_constraint are bounded by constants: the runtime
+ iq is switched on to instantiate one kernel per value, each unrolled into 
+ straight-line code. Larger or Dynamic sizes keep the loops.
+ */
+const int max_unrolled_n = 8;
+
+/* the bound of the switch on iq, or Dynamic for no switch */
 template<int n>
-inline void update_z(EVECd(n)& z, const EMATd(n, n)& J, const EVECd(n)& d, int iq)
+struct unrolled_size
 {
-	register int i, j;
+	enum { value = n != Dynamic && n <= max_unrolled_n ? n : Dynamic };
+};
 
-	/* setting of z = H * d */
-	for (i = 0; i < n; i++)
+/* calls kernel.template run<iq>() for the runtime 0 <= iq <= Max */
+template<int Max, int IQ = 0>
+struct dispatch_iq
+{
+	template<typename Kernel>
+	static inline void run(int iq, const Kernel& kernel)
 	{
-		z(i) = 0.0;
-		for (j = iq; j < n; j++)
-			z(i) += J(i, j) * d(j);
+		if (iq == IQ)
+			kernel.template run<IQ>();
+		else
+			dispatch_iq<Max, IQ + 1>::run(iq, kernel);
 	}
+};
+
+template<int Max>
+struct dispatch_iq<Max, Max>
+{
+	template<typename Kernel>
+	static inline void run(int, const Kernel& kernel)
+	{
+		kernel.template run<Max>();
+	}
+};
+
+/* no switch: kernel.run(iq) loops up to iq */
+template<>
+struct dispatch_iq<Dynamic, 0>
+{
+	template<typename Kernel>
+	static inline void run(int iq, const Kernel& kernel)
+	{
+		kernel.run(iq);
+	}
+};
+
+template<typename MatN, typename VecN>
+struct update_z_kernel
+{
+	VecN& z; const MatN& J; const VecN& d;
+	update_z_kernel(VecN& z, const MatN& J, const VecN& d) : z(z), J(J), d(d) { }
+
+	/* setting of z = H * d, the first iq components of d being skipped; the
+	   product is kept at the full size n so that a fixed one is unrolled */
+	void run(int iq) const
+	{
+		VecN dt = d;
+		dt.head(iq).setZero();
+		z.noalias() = J * dt;
+	}
+
+	/* the same for a compile-time iq: only the last n - iq columns of H */
+	template<int iq>
+	void run() const
+	{
+		enum { n = MatN::RowsAtCompileTime };
+		z.noalias() = J.template rightCols<n - iq>() * d.template tail<n - iq>();
+	}
+};
+
+template<typename MatN, typename VecN>
+inline void update_z(VecN& z, const MatN& J, const VecN& d, int iq)
+{
+	dispatch_iq<unrolled_size<MatN::RowsAtCompileTime>::value>::run(iq, update_z_kernel<MatN, VecN>(z, J, d));
 }
 
-template<int n, int p, int m>
-inline void update_r(const EMATd(n, n)& R, EVECd(m + p)& r, const EVECd(n)& d, int iq)
+template<typename MatN, typename VecMP, typename VecN>
+struct update_r_kernel
 {
-	register int i, j;/*, n = EROWS(d);*/
-	register double sum;
+	const MatN& R; VecMP& r; const VecN& d;
+	update_r_kernel(const MatN& R, VecMP& r, const VecN& d) : R(R), r(r), d(d) { }
 
 	/* setting of r = R^-1 d */
-	for (i = iq - 1; i >= 0; i--)
+	void run(int iq) const
 	{
-		sum = 0.0;
-		for (j = i + 1; j < iq; j++)
-			sum += R(i, j) * r(j);
-		r(i) = (d(i) - sum) / R(i, i);
+		r.head(iq) = d.head(iq);
+		R.topLeftCorner(iq, iq).template triangularView<Upper>().solveInPlace(r.head(iq));
 	}
+
+	template<int iq>
+	void run() const
+	{
+		r.template head<iq>() = d.template head<iq>();
+		R.template topLeftCorner<iq, iq>().template triangularView<Upper>().solveInPlace(r.template head<iq>());
+	}
+};
+
+template<typename MatN, typename VecMP, typename VecN>
+inline void update_r(const MatN& R, VecMP& r, const VecN& d, int iq)
+{
+	/* iq is bounded by both n and the number of constraints */
+	enum { n = MatN::RowsAtCompileTime, mp = VecMP::RowsAtCompileTime };
+	dispatch_iq<unrolled_size<(n < mp ? n : mp)>::value>::run(iq, update_r_kernel<MatN, VecMP, VecN>(R, r, d));
 }
 
-template<int n>
-bool add_constraint(EMATd(n, n)& R, EMATd(n, n)& J, EVECd(n)& d, int& iq, double& R_norm)
+template<typename MatN, typename VecN>
+inline void givens_step(MatN& J, VecN& d, int j)
 {
-#ifdef TRACE_SOLVER
-	std::cout << "Add constraint " << iq << '/';
-#endif
-	register int i, j, k;
-	double cc, ss, h, t1, t2, xny;
+	typedef typename MatN::Scalar Scalar;
+	Scalar cc, ss, h, xny;
 
-	/* we have to find the Givens rotation which will reduce the element
-    d(j) to zero.
-    if it is already zero we don't have to do anything, except of
-    decreasing j */  
-	for (j = n - 1; j >= iq + 1; j--)
-	{
-		/* The Givens rotation is done with the ublas::matrix (cc cs, cs -cc).
+	/* The Givens rotation is done with the ublas::matrix (cc cs, cs -cc).
     If cc is one, then element (j) of d is zero compared with element
     (j - 1). Hence we don't have to do anything. 
     If cc is zero, then we just have to switch column (j) and column (j - 1) 
@@ -155,31 +271,62 @@ bool add_constraint(EMATd(n, n)& R, EMATd(n, n)& J, EVECd(n)& d, int& iq, double
     update d depending on the sign of gs.
     Otherwise we have to apply the Givens rotation to these columns.
     The i - 1 element of d has to be updated to h. */
-		cc = d(j - 1);
-		ss = d(j);
-		h = distance(cc, ss);
-		if (fabs(h) < std::numeric_limits<double>::epsilon()) // h == 0
-			continue;
-		d(j) = 0.0;
-		ss = ss / h;
-		cc = cc / h;
-		if (cc < 0.0)
-		{
-			cc = -cc;
-			ss = -ss;
-			d(j - 1) = -h;
-		}
-		else
-			d(j - 1) = h;
-		xny = ss / (1.0 + cc);
-		for (k = 0; k < n; k++)
-		{
-			t1 = J(k, j - 1);
-			t2 = J(k, j);
-			J(k, j - 1) = t1 * cc + t2 * ss;
-			J(k, j) = xny * (t1 + J(k, j - 1)) - t2;
-		}
+	cc = d(j - 1);
+	ss = d(j);
+	h = distance(cc, ss);
+	if (std::abs(h) < std::numeric_limits<Scalar>::epsilon()) // h == 0
+		return;
+	d(j) = 0.0;
+	ss = ss / h;
+	cc = cc / h;
+	if (cc < 0.0)
+	{
+		cc = -cc;
+		ss = -ss;
+		d(j - 1) = -h;
 	}
+	else
+		d(j - 1) = h;
+	xny = ss / (1.0 + cc);
+	apply_givens<MatN::RowsAtCompileTime>(&J(0, j - 1), &J(0, j), J.rows(), cc, ss, xny);
+}
+
+template<typename MatN, typename VecN>
+struct givens_kernel
+{
+	MatN& J; VecN& d;
+	givens_kernel(MatN& J, VecN& d) : J(J), d(d) { }
+
+	/* we have to find the Givens rotation which will reduce the element
+    d(j) to zero.
+    if it is already zero we don't have to do anything, except of
+    decreasing j */  
+	void run(int iq) const
+	{
+		for (int j = J.rows() - 1; j >= iq + 1; j--)
+			givens_step(J, d, j);
+	}
+
+	template<int iq>
+	void run() const
+	{
+		for (int j = MatN::RowsAtCompileTime - 1; j >= iq + 1; j--)
+			givens_step(J, d, j);
+	}
+};
+
+template<typename MatN, typename VecN>
+bool add_constraint(MatN& R, MatN& J, VecN& d, int& iq, typename MatN::Scalar& R_norm)
+{
+#ifdef TRACE_SOLVER
+	std::cout << "Add constraint " << iq << '/';
+#endif
+	typedef typename MatN::Scalar Scalar;
+	int i;
+
+	/* iq < n on entry */
+	enum { n = MatN::RowsAtCompileTime };
+	dispatch_iq<unrolled_size<n>::value == Dynamic ? Dynamic : n - 1>::run(iq, givens_kernel<MatN, VecN>(J, d));
 	/* update the number of constraints added*/
 	iq++;
 	/* To update R we have to put the iq components of the d ublas::vector
@@ -194,23 +341,25 @@ bool add_constraint(EMATd(n, n)& R, EMATd(n, n)& J, EVECd(n)& d, int& iq, double
 	print_stuff("d", d, iq);
 #endif
 
-	if (fabs(d(iq - 1)) <= std::numeric_limits<double>::epsilon() * R_norm) 
+	if (std::abs(d(iq - 1)) <= std::numeric_limits<Scalar>::epsilon() * R_norm) 
 	{
 		// problem degenerate
 		return false;
 	}
-	R_norm = std::max<double>(R_norm, fabs(d(iq - 1)));
+	R_norm = std::max<Scalar>(R_norm, std::abs(d(iq - 1)));
 	return true;
 }
 
-template<int n, int p, int m>
-void delete_constraint(EMATd(n, n)& R, EMATd(n, n)& J, EVECi(m + p)& A, EVECd(m + p)& u, int _unsed_n, int _unsed_p, int& iq, int l)
+template<typename MatN, typename VecIMP, typename VecMP>
+void delete_constraint(MatN& R, MatN& J, VecIMP& A, VecMP& u, int p, int& iq, int l)
 {
 #ifdef TRACE_SOLVER
 	std::cout << "Delete constraint " << l << ' ' << iq;
 #endif
-	register int i, j, k, qq = -1; // just to prevent warnings from smart compilers
-	double cc, ss, h, xny, t1, t2;
+	typedef typename MatN::Scalar Scalar;
+	const int n = J.rows();
+	int i, j, k, qq = -1; // just to prevent warnings from smart compilers
+	Scalar cc, ss, h, xny, t1, t2;
 
 	/* Find the index qq for active constraint l to be removed */
 	for (i = p; i < iq; i++)
@@ -249,7 +398,7 @@ void delete_constraint(EMATd(n, n)& R, EMATd(n, n)& J, EVECi(m + p)& A, EVECd(m
 		cc = R(j, j);
 		ss = R(j + 1, j);
 		h = distance(cc, ss);
-		if (fabs(h) < std::numeric_limits<double>::epsilon()) // h == 0
+		if (std::abs(h) < std::numeric_limits<Scalar>::epsilon()) // h == 0
 			continue;
 		cc = cc / h;
 		ss = ss / h;
@@ -271,33 +420,36 @@ void delete_constraint(EMATd(n, n)& R, EMATd(n, n)& J, EVECi(m + p)& A, EVECd(m
 			R(j, k) = t1 * cc + t2 * ss;
 			R(j + 1, k) = xny * (t1 + R(j, k)) - t2;
 		}
-		for (k = 0; k < n; k++)
-		{
-			t1 = J(k, j);
-			t2 = J(k, j + 1);
-			J(k, j) = t1 * cc + t2 * ss;
-			J(k, j + 1) = xny * (J(k, j) + t1) - t2;
-		}
+		apply_givens<MatN::RowsAtCompileTime>(&J(0, j), &J(0, j + 1), n, cc, ss, xny);
 	}
 }
 
-template<int n>
-inline double scalar_product(const EVECd(n)& x, const EVECd(n)& y)
+template<typename VecN>
+inline typename VecN::Scalar scalar_product(const VecN& x, const VecN& y)
 {
-	register int i;
-	register double sum;
+	return x.dot(y);
+}
 
-	sum = 0.0;
-	for (i = 0; i < n; i++)
-		sum += x(i) * y(i);
-	return sum;			
+/* true if every off-diagonal element of G is zero */
+template<typename MatN>
+inline bool is_diagonal(const MatN& G)
+{
+	const int n = G.rows();
+	int i, j;
+
+	for (j = 0; j < n; j++)
+		for (i = 0; i < n; i++)
+			if (i != j && G(i, j) != 0.0)
+				return false;
+	return true;
 }
 
-template<int n>
-void cholesky_decomposition(EMATd(n, n)& A) 
+template<typename MatN>
+void cholesky_decomposition(MatN& A) 
 {
-	register int i, j, k;
-	register double sum;
+	const int n = A.rows();
+	int i, j, k;
+	typename MatN::Scalar sum;
 
 	for (i = 0; i < n; i++)
 	{
@@ -327,24 +479,11 @@ void cholesky_decomposition(EMATd(n, n)& A)
 	} 
 }
 
-// TODO: Replace this with Eigen implementation!
-
-template<int n>
-void cholesky_solve(const EMATd(n, n)& L, EVECd(n)& x, const EVECd(n)& b)
+template<typename MatN, typename VecN>
+inline void forward_elimination(const MatN& L, VecN& y, const VecN& b)
 {
-	static EVECd(n) y;
-	y.setZero(n);
-
-	/* Solve L * y = b */
-	forward_elimination(L, y, b);
-	/* Solve L^T * x = y */
-	backward_elimination(L, x, y);
-}
-
-template<int n>
-inline void forward_elimination(const EMATd(n, n)& L, EVECd(n)& y, const EVECd(n)& b)
-{
-	register int i, j;
+	const int n = L.rows();
+	int i, j;
 
 	y(0) = b(0) / L(0, 0);
 	for (i = 1; i < n; i++)
@@ -356,10 +495,11 @@ inline void forward_elimination(const EMATd(n, n)& L, EVECd(n)& y, const EVECd(n
 	}
 }
 
-template<int n>
-inline void backward_elimination(const EMATd(n, n)& U, EVECd(n)& x, const EVECd(n)& y)
+template<typename MatN, typename VecN>
+inline void backward_elimination(const MatN& U, VecN& x, const VecN& y)
 {
-	register int i, j;
+	const int n = U.rows();
+	int i, j;
 
 	x(n - 1) = y(n - 1) / U(n - 1, n - 1);
 	for (i = n - 2; i >= 0; i--)
@@ -372,40 +512,171 @@ inline void backward_elimination(const EMATd(n, n)& U, EVECd(n)& x, const EVECd(
 }
 
 
+// TODO: Replace this with Eigen implementation!
 
+template<typename MatN, typename VecN>
+void cholesky_solve(const MatN& L, VecN& x, const VecN& b)
+{
+	VecN y(b.size());
 
+	/* Solve L * y = b */
+	forward_elimination(L, y, b);
+	/* Solve L^T * x = y */
+	backward_elimination(L, x, y);
+}
+
+/*
+ Work matrices and vectors used by solve_quadprog<n, p, m>().
+ Everything is fixed-size, so a Workspace can live on the stack or be held
+ per thread without any heap allocation, and two threads solving problems of
+ the same size do not share any state.
+ The Scalar type defaults to double; a Workspace<n, p, m, float> solves in
+ single precision, with the tolerances scaled to its epsilon.
+ A batch of problems of one size is best solved one after the other on one
+ Workspace per thread: solving 4 of them in lockstep, one per SIMD lane,
+ was at most as fast, since the lanes soon diverge in their active sets.
+ */
+template<int n, int p, int m, typename Scalar = double>
+struct Workspace
+{
+	/* argument types of solve_quadprog<n, p, m>() */
+	typedef EMAT(n, n) MatG;
+	typedef EVEC(n) VecX;
+	typedef EMAT(n, p) MatCE;
+	typedef EVEC(p) VecCE;
+	typedef EMAT(n, m) MatCI;
+	typedef EVEC(m) VecCI;
+	/* work types, and the sizes known at compile time */
+	typedef EMAT(n, n) MatN;
+	typedef EVEC(n) VecN;
+	typedef EVEC(m + p) VecMP;
+	typedef EVECi(m + p) VecIMP;
+	typedef Matrix<bool, m + p, 1> VecBMP;
+	typedef EVEC(m) VecM;
+	typedef EVECi(m) VecIM;
+	enum { N = n, P = p, M = m };
+
+	MatN L, R, J;
+	VecMP s, r, u, u_old;
+	VecN z, d, np, x_old;
+	VecIMP A, A_old, iai;
+	VecBMP iaexcl;
+	/* inequality i is the row lower(i) <= CI(:,i)^T x <= upper(i); side(i) is
+	   +1 if its lower end is the active (or violated) one, -1 for the upper */
+	VecM lower, upper;
+	VecIM side;
+
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/*
+ Work matrices and vectors for problem sizes n, p and m chosen at run time,
+ up to NMax, PMax and MMax: every matrix is stored in place at its maximal
+ size (Eigen's MaxRows and MaxCols), so that, like a Workspace, it never 
+ allocates on the heap and a solve runs under EIGEN_NO_MALLOC. The problem is
+ passed in the same bounded types, MatG, VecX, ... below, which do not 
+ allocate either.
+ A BoundedWorkspace occupies as much memory as a Workspace of the maximal
+ sizes, whatever the current ones.
+ */
+template<int NMax, int PMax, int MMax, typename Scalar = double>
+struct BoundedWorkspace
+{
+	/* argument types of solve_quadprog() */
+	typedef Matrix<Scalar, Dynamic, Dynamic, 0, NMax, NMax> MatG;
+	typedef Matrix<Scalar, Dynamic, 1, 0, NMax, 1> VecX;
+	typedef Matrix<Scalar, Dynamic, Dynamic, 0, NMax, PMax> MatCE;
+	typedef Matrix<Scalar, Dynamic, 1, 0, PMax, 1> VecCE;
+	typedef Matrix<Scalar, Dynamic, Dynamic, 0, NMax, MMax> MatCI;
+	typedef Matrix<Scalar, Dynamic, 1, 0, MMax, 1> VecCI;
+	/* work types; no size is known at compile time */
+	typedef MatG MatN;
+	typedef VecX VecN;
+	typedef Matrix<Scalar, Dynamic, 1, 0, MMax + PMax, 1> VecMP;
+	typedef Matrix<int, Dynamic, 1, 0, MMax + PMax, 1> VecIMP;
+	typedef Matrix<bool, Dynamic, 1, 0, MMax + PMax, 1> VecBMP;
+	typedef VecCI VecM;
+	typedef Matrix<int, Dynamic, 1, 0, MMax, 1> VecIM;
+	enum { N = Dynamic, P = Dynamic, M = Dynamic };
+
+	MatN L, R, J;
+	VecMP s, r, u, u_old;
+	VecN z, d, np, x_old;
+	VecIMP A, A_old, iai;
+	VecBMP iaexcl;
+	VecM lower, upper;
+	VecIM side;
+
+	BoundedWorkspace() { }
+	BoundedWorkspace(int n, int p, int m) { resize(n, p, m); }
+
+	/* sets the current sizes; this only changes the dimensions of the 
+	   in-place storage */
+	void resize(int n, int p, int m)
+	{
+		if (n > NMax || p > PMax || m > MMax)
+		{
+			std::ostringstream msg;
+			msg << "The problem dimensions (n = " << n << ", p = " << p << ", m = " << m 
+				<< ") exceed the bounds of the workspace (" << NMax << ", " << PMax << ", " 
+				<< MMax << ")";
+			throw std::logic_error(msg.str());
+		}
+		L.resize(n, n);
+		R.resize(n, n);
+		J.resize(n, n);
+		s.resize(m + p);
+		r.resize(m + p);
+		u.resize(m + p);
+		u_old.resize(m + p);
+		z.resize(n);
+		d.resize(n);
+		np.resize(n);
+		x_old.resize(n);
+		A.resize(m + p);
+		A_old.resize(m + p);
+		iai.resize(m + p);
+		iaexcl.resize(m + p);
+		lower.resize(m);
+		upper.resize(m);
+		side.resize(m);
+	}
 
-template<int n, int p, int m>
-double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0, 
-		const EMATd(n, p)& CE, const EVECd(p)& ce0,  
-		const EMATd(n, m)& CI, const EVECd(m)& ci0, 
-		EVECd(n)& x)
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/* The method, for the inequality rows set up in ws.lower and ws.upper; WS is
+   a Workspace or a BoundedWorkspace of the problem sizes */
+template<typename WS>
+typename WS::MatN::Scalar solve_quadprog_rows(WS& ws,
+		const typename WS::MatG& G, const typename WS::VecX& g0, 
+		const typename WS::MatCE& CE, const typename WS::VecCE& ce0,  
+		const typename WS::MatCI& CI, 
+		typename WS::VecX& x)
 {
-	std::ostringstream msg;
 	{
-		// Static typing handles sizes
-		register int i, j, k, l; /* indices */
+		typedef typename WS::MatN::Scalar Scalar;
+		/* compile-time constants for a Workspace */
+		const int n = G.rows(), p = CE.cols(), m = CI.cols();
+		int i, j, k, l; /* indices */
 		int ip; // this is the index of the constraint to be added to the active set
-		static EMATd(n,n) R, J;
-		static EVECd(m + p) s, r, u, u_old;
-		static EVECd(n) z, d, np, x_old;
-		double f_value, psi, c1, c2, sum, ss, R_norm;
-		double inf;
-		if (std::numeric_limits<double>::has_infinity)
-			inf = std::numeric_limits<double>::infinity();
+		typename WS::MatN &L = ws.L, &R = ws.R, &J = ws.J;
+		typename WS::VecMP &s = ws.s, &r = ws.r, &u = ws.u, &u_old = ws.u_old;
+		typename WS::VecN &z = ws.z, &d = ws.d, &np = ws.np, &x_old = ws.x_old;
+		Scalar f_value, psi, c1, c2, sum, ss, R_norm;
+		Scalar inf;
+		if (std::numeric_limits<Scalar>::has_infinity)
+			inf = std::numeric_limits<Scalar>::infinity();
 		else
 			inf = 1.0E300;
-		double t, t1, t2; /* t is the step lenght, which is the minimum of the partial step length t1 
+		Scalar t, t1, t2; /* t is the step lenght, which is the minimum of the partial step length t1 
 		 * and the full step length t2 */
-		static EVECi(m + p) A, A_old, iai;
-		int q, iq, iter = 0;
-		// Meh...
-		//vector<bool> iaexcl(m + p);
-		bool iaexcl[m + p];
+		typename WS::VecIMP &A = ws.A, &A_old = ws.A_old, &iai = ws.iai;
+		int iq, iter = 0;
+		typename WS::VecBMP &iaexcl = ws.iaexcl;
 
 		/* p is the number of equality constraints */
 		/* m is the number of inequality constraints */
-		q = 0;  /* size of the active set A (containing the indices of the active constraints) */
 #ifdef TRACE_SOLVER
 		std::cout << std::endl << "Starting solve_quadprog" << std::endl;
 		print_stuff("G", G);
@@ -413,8 +684,15 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 		print_stuff("CE", CE);
 		print_stuff("ce0", ce0);
 		print_stuff("CI", CI);
-		print_stuff("ci0", ci0);
-#endif  
+		print_stuff("lower", ws.lower);
+		print_stuff("upper", ws.upper);
+#endif
+
+		/* step 2 only checks the rows out of the active set: a row with
+		 * lower(i) > upper(i), which no x satisfies, is rejected here */
+		for (i = 0; i < m; i++)
+			if (ws.lower(i) > ws.upper(i))
+				return inf;
 
 		/*
 		 * Preprocessing phase
@@ -426,11 +704,6 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 		{
 			c1 += G(i, i);
 		}
-		/* decompose the ublas::matrix G in the form L^T L */
-		cholesky_decomposition(G);
-#ifdef TRACE_SOLVER
-		print_stuff("G", G);
-#endif
 		/* initialize the ublas::matrix R */
 		for (i = 0; i < n; i++)
 		{
@@ -440,16 +713,45 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 		}
 		R_norm = 1.0; /* this variable will hold the norm of the ublas::matrix R */
 
-		/* compute the inverse of the factorized ublas::matrix G^-1, this is the initial value for H */
-		c2 = 0.0;
-		for (i = 0; i < n; i++) 
+		/* a diagonal G is its own factorization: L = G^1/2 and the initial
+		 * H = L^-T are diagonal */
+		const bool diagonal = is_diagonal(G);
+		if (diagonal)
 		{
-			d(i) = 1.0;
-			forward_elimination(G, z, d);
-			for (j = 0; j < n; j++)
-				J(i, j) = z(j);
-			c2 += z(i);
-			d(i) = 0.0;
+			for (i = 0; i < n; i++)
+				if (!(G(i, i) > 0.0))
+				{
+					std::ostringstream os;
+					os << "Error in cholesky decomposition, sum: " << G(i, i);
+					throw std::logic_error(os.str());
+				}
+			L.setZero();
+			L.diagonal() = G.diagonal().cwiseSqrt();
+			J.setZero();
+			J.diagonal() = L.diagonal().cwiseInverse();
+			c2 = J.trace();
+		}
+		else
+		{
+			/* decompose the ublas::matrix G in the form L^T L, on a copy so that the
+			 * caller's G is left untouched */
+			L = G;
+			cholesky_decomposition(L);
+#ifdef TRACE_SOLVER
+			print_stuff("L", L);
+#endif
+
+			/* compute the inverse of the factorized ublas::matrix G^-1, this is the initial value for H */
+			c2 = 0.0;
+			for (i = 0; i < n; i++) 
+			{
+				d(i) = 1.0;
+				forward_elimination(L, z, d);
+				for (j = 0; j < n; j++)
+					J(i, j) = z(j);
+				c2 += z(i);
+				d(i) = 0.0;
+			}
 		}
 #ifdef TRACE_SOLVER
 		print_stuff("J", J);
@@ -462,9 +764,16 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 		 * this is a feasible point in the dual space
 		 * x = G^-1 * g0
 		 */
-		cholesky_solve(G, x, g0);
-		for (i = 0; i < n; i++)
-			x(i) = -x(i);
+		if (diagonal)
+			x = -g0.cwiseQuotient(L.diagonal()).cwiseQuotient(L.diagonal());
+		else
+		{
+			/* same as cholesky_solve(L, x, g0), using z as scratch space */
+			forward_elimination(L, z, g0);
+			backward_elimination(L, x, z);
+			for (i = 0; i < n; i++)
+				x(i) = -x(i);
+		}
 		/* and compute the current solution value */ 
 		f_value = 0.5 * scalar_product(g0, x);
 #ifdef TRACE_SOLVER
@@ -480,7 +789,7 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 				np(j) = CE(j, i);
 			compute_d(d, J, np);
 			update_z(z, J, d, iq);
-			update_r<n, p, m>(R, r, d, iq);
+			update_r(R, r, d, iq);
 #ifdef TRACE_SOLVER
 			print_stuff("R", R, n, iq);
 			print_stuff("z", z);
@@ -491,7 +800,7 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 			/* compute full step length t2: i.e., the minimum step in primal space s.t. the contraint 
       becomes feasible */
 			t2 = 0.0;
-			if (fabs(scalar_product(z, z)) > std::numeric_limits<double>::epsilon()) // i.e. z != 0
+			if (std::abs(scalar_product(z, z)) > std::numeric_limits<Scalar>::epsilon()) // i.e. z != 0
 				t2 = (-scalar_product(np, x) - ce0(i)) / scalar_product(z, np);
 
 			/* set x = x + t2 * z */
@@ -530,30 +839,24 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 			iai(ip) = -1;
 		}
 
-		/* compute s(x) = ci^T * x + ci0 for all elements of K \ A */
+		/* compute s(x), the slack of the nearer end of each row, for all elements of K \ A */
 		ss = 0.0;
 		psi = 0.0; /* this value will contain the sum of all infeasibilities */
 		ip = 0; /* ip will be the index of the chosen violated constraint */
-		for (i = 0; i < m; i++)
-		{
-			iaexcl[i] = true;
-			sum = 0.0;
-			for (j = 0; j < n; j++)
-				sum += CI(j, i) * x(j);
-			sum += ci0(i);
-			s(i) = sum;
-			psi += std::min(0.0, sum);
-		}
+		/* a single matrix-vector product rather than m dot products; every
+		   element is recomputed from x, so no error accumulates across steps */
+		s.template head<WS::M>(m).noalias() = CI.transpose() * x;
+		s.template head<WS::M>(m) = (s.template head<WS::M>(m) - ws.lower).cwiseMin(ws.upper - s.template head<WS::M>(m));
+		psi = s.template head<WS::M>(m).cwiseMin(0.0).sum();
+		iaexcl.setConstant(true);
 #ifdef TRACE_SOLVER
 		print_stuff("s", s, m);
 #endif
 
 
-		if (fabs(psi) <= m * std::numeric_limits<double>::epsilon() * c1 * c2* 100.0)
+		if (std::abs(psi) <= m * std::numeric_limits<Scalar>::epsilon() * c1 * c2 * infeasibility_margin<Scalar>())
 		{
 			/* numerically there are not infeasibilities anymore */
-			q = iq;
-
 			return f_value;
 		}
 
@@ -570,7 +873,7 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 		l2: /* Step 2: check for feasibility and determine a new S-pair */
 		for (i = 0; i < m; i++)
 		{
-			if (s(i) < ss && iai(i) != -1 && iaexcl[i])
+			if (s(i) < ss && iai(i) != -1 && iaexcl(i))
 			{
 				ss = s(i);
 				ip = i;
@@ -578,14 +881,14 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 		}
 		if (ss >= 0.0)
 		{
-			q = iq;
-
 			return f_value;
 		}
 
-		/* set np = n(ip) */
-		for (i = 0; i < n; i++)
-			np(i) = CI(i, ip);
+		/* set np = n(ip), pointing into the violated end of the row */
+		constraint_column(np, CI, ip);
+		sum = np.dot(x);
+		ws.side(ip) = sum - ws.lower(ip) <= ws.upper(ip) - sum ? 1 : -1;
+		np *= ws.side(ip);
 		/* set u = (u 0)^T */
 		u(iq) = 0.0;
 		/* add ip to the active set A */
@@ -601,7 +904,7 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 		compute_d(d, J, np);
 		update_z(z, J, d, iq);
 		/* compute N* np (if q > 0): the negative of the step direction in the dual space */
-		update_r<n, p, m>(R, r, d, iq);
+		update_r(R, r, d, iq);
 #ifdef TRACE_SOLVER
 		std::cout << "Step direction z" << std::endl;
 		print_stuff("z", z);
@@ -628,7 +931,7 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 			}
 		}
 		/* Compute t2: full step length (minimum step in primal space such that the constraint ip becomes feasible */
-		if (fabs(scalar_product(z, z))  > std::numeric_limits<double>::epsilon()) // i.e. z != 0
+		if (std::abs(scalar_product(z, z))  > std::numeric_limits<Scalar>::epsilon()) // i.e. z != 0
 			t2 = -s(ip) / scalar_product(z, np);
 		else
 			t2 = inf; /* +inf */
@@ -646,7 +949,6 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 		{
 			/* QPP is infeasible */
 			// FIXME: unbounded to raise
-			q = iq;
 			return inf;
 		}
 		/* case (ii): step in dual space */
@@ -657,7 +959,7 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 				u(k) -= t * r(k);
 			u(iq) += t;
 			iai(l) = l;
-			delete_constraint<n, p, m>(R, J, A, u, n, p, iq, l);
+			delete_constraint(R, J, A, u, p, iq, l);
 #ifdef TRACE_SOLVER
 			std::cout << " in dual space: " 
 					<< f_value << std::endl;
@@ -688,7 +990,7 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 		print_stuff("A", A, iq + 1);
 #endif
 
-		if (fabs(t - t2) < std::numeric_limits<double>::epsilon())
+		if (std::abs(t - t2) < std::numeric_limits<Scalar>::epsilon())
 		{
 #ifdef TRACE_SOLVER
 			std::cout << "Full step has taken " << t << std::endl;
@@ -698,8 +1000,8 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 			/* add constraint ip to the active set*/
 			if (!add_constraint(R, J, d, iq, R_norm))
 			{
-				iaexcl[ip] = false;
-				delete_constraint<n, p, m>(R, J, A, u, n, p, iq, ip);
+				iaexcl(ip) = false;
+				delete_constraint(R, J, A, u, p, iq, ip);
 #ifdef TRACE_SOLVER
 				print_stuff("R", R);
 				print_stuff("A", A, iq);
@@ -734,17 +1036,16 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 #endif
 		/* drop constraint l */
 		iai(l) = l;
-		delete_constraint<n, p, m>(R, J, A, u, n, p, iq, l);
+		delete_constraint(R, J, A, u, p, iq, l);
 #ifdef TRACE_SOLVER
 		print_stuff("R", R);
 		print_stuff("A", A, iq);
 #endif
 
-		/* update s(ip) = CI * x + ci0 */
-		sum = 0.0;
-		for (k = 0; k < n; k++)
-			sum += CI(k, ip) * x(k);
-		s(ip) = sum + ci0(ip);
+		/* update s(ip) = CI * x + ci0, at the end of row ip being added;
+		   np is still its column times side(ip) */
+		sum = ws.side(ip) * np.dot(x);
+		s(ip) = ws.side(ip) > 0 ? sum - ws.lower(ip) : ws.upper(ip) - sum;
 
 #ifdef TRACE_SOLVER
 		print_stuff("s", s, m);
@@ -754,6 +1055,150 @@ double solve_quadprog(EMATd(n, n)& G, EVECd(n)& g0,
 
 }
 
+template<int n, int p, int m, typename Scalar>
+Scalar solve_quadprog(Workspace<n, p, m, Scalar>& ws,
+		const typename Workspace<n, p, m, Scalar>::MatG& G,
+		const typename Workspace<n, p, m, Scalar>::VecX& g0,
+		const typename Workspace<n, p, m, Scalar>::MatCE& CE,
+		const typename Workspace<n, p, m, Scalar>::VecCE& ce0,
+		const typename Workspace<n, p, m, Scalar>::MatCI& CI,
+		const typename Workspace<n, p, m, Scalar>::VecCI& ci0,
+		EVEC(n)& x)
+{
+	/* CI^T x + ci0 >= 0 is a row with no upper end */
+	ws.lower = -ci0;
+	ws.upper.setConstant(std::numeric_limits<Scalar>::infinity());
+	return solve_quadprog_rows(ws, G, g0, CE, ce0, CI, x);
+}
+
+/*
+ Two-sided inequalities cl <= CI^T x <= cu, without duplicating CI. A row is
+ active at one end at a time, and an infinite cl(i) or cu(i) leaves that end
+ open.
+ */
+template<int n, int p, int m, typename Scalar>
+Scalar solve_quadprog(Workspace<n, p, m, Scalar>& ws,
+		const typename Workspace<n, p, m, Scalar>::MatG& G,
+		const typename Workspace<n, p, m, Scalar>::VecX& g0,
+		const typename Workspace<n, p, m, Scalar>::MatCE& CE,
+		const typename Workspace<n, p, m, Scalar>::VecCE& ce0,
+		const typename Workspace<n, p, m, Scalar>::MatCI& CI,
+		const typename Workspace<n, p, m, Scalar>::VecCI& cl,
+		const typename Workspace<n, p, m, Scalar>::VecCI& cu,
+		EVEC(n)& x)
+{
+	ws.lower = cl;
+	ws.upper = cu;
+	return solve_quadprog_rows(ws, G, g0, CE, ce0, CI, x);
+}
+
+/*
+ Convenience overload using a Workspace on the stack. This is re-entrant, but
+ for large n the workspace may be better held by the caller.
+ */
+template<int n, int p, int m, typename Scalar = double>
+inline Scalar solve_quadprog(
+		const typename Workspace<n, p, m, Scalar>::MatG& G,
+		const typename Workspace<n, p, m, Scalar>::VecX& g0,
+		const typename Workspace<n, p, m, Scalar>::MatCE& CE,
+		const typename Workspace<n, p, m, Scalar>::VecCE& ce0,
+		const typename Workspace<n, p, m, Scalar>::MatCI& CI,
+		const typename Workspace<n, p, m, Scalar>::VecCI& ci0,
+		EVEC(n)& x)
+{
+	Workspace<n, p, m, Scalar> ws;
+	return solve_quadprog(ws, G, g0, CE, ce0, CI, ci0, x);
+}
+
+template<int n, int p, int m, typename Scalar = double>
+inline Scalar solve_quadprog(
+		const typename Workspace<n, p, m, Scalar>::MatG& G,
+		const typename Workspace<n, p, m, Scalar>::VecX& g0,
+		const typename Workspace<n, p, m, Scalar>::MatCE& CE,
+		const typename Workspace<n, p, m, Scalar>::VecCE& ce0,
+		const typename Workspace<n, p, m, Scalar>::MatCI& CI,
+		const typename Workspace<n, p, m, Scalar>::VecCI& cl,
+		const typename Workspace<n, p, m, Scalar>::VecCI& cu,
+		EVEC(n)& x)
+{
+	Workspace<n, p, m, Scalar> ws;
+	return solve_quadprog(ws, G, g0, CE, ce0, CI, cl, cu, x);
+}
+
+
+/* Checks the dimensions of a problem for a BoundedWorkspace, and sets its
+   current sizes */
+template<int NMax, int PMax, int MMax, typename Scalar>
+inline void resize_bounded(BoundedWorkspace<NMax, PMax, MMax, Scalar>& ws,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::MatG& G,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecX& g0,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::MatCE& CE,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecCE& ce0,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::MatCI& CI,
+		int ci_rows)
+{
+	int n = G.rows(), p = CE.cols(), m = CI.cols();
+	if (G.cols() != n || g0.size() != n || CE.rows() != n || ce0.size() != p || 
+		CI.rows() != n || ci_rows != m)
+	{
+		std::ostringstream msg;
+		msg << "The dimensions of the problem are inconsistent: G is " << G.rows() << " x " 
+			<< G.cols() << ", g0 has " << g0.size() << " elements, CE is " << CE.rows() << " x " 
+			<< CE.cols() << ", ce0 has " << ce0.size() << ", CI is " << CI.rows() << " x " 
+			<< CI.cols() << " and its right hand sides have " << ci_rows;
+		throw std::logic_error(msg.str());
+	}
+	ws.resize(n, p, m);
+}
+
+/*
+ The same, for sizes bounded by those of the BoundedWorkspace (see above); x is
+ resized to n, within its own bound.
+ */
+template<int NMax, int PMax, int MMax, typename Scalar>
+Scalar solve_quadprog(BoundedWorkspace<NMax, PMax, MMax, Scalar>& ws,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::MatG& G,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecX& g0,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::MatCE& CE,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecCE& ce0,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::MatCI& CI,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecCI& ci0,
+		typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecX& x)
+{
+	resize_bounded(ws, G, g0, CE, ce0, CI, ci0.size());
+	x.resize(G.rows());
+	ws.lower = -ci0;
+	ws.upper.setConstant(std::numeric_limits<Scalar>::infinity());
+	return solve_quadprog_rows(ws, G, g0, CE, ce0, CI, x);
+}
+
+template<int NMax, int PMax, int MMax, typename Scalar>
+Scalar solve_quadprog(BoundedWorkspace<NMax, PMax, MMax, Scalar>& ws,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::MatG& G,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecX& g0,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::MatCE& CE,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecCE& ce0,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::MatCI& CI,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecCI& cl,
+		const typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecCI& cu,
+		typename BoundedWorkspace<NMax, PMax, MMax, Scalar>::VecX& x)
+{
+	if (cl.size() != cu.size())
+	{
+		std::ostringstream msg;
+		msg << "The ranges cl and cu have different dimensions (" 
+			<< cl.size() << " and " << cu.size() << ")";
+		throw std::logic_error(msg.str());
+	}
+	resize_bounded(ws, G, g0, CE, ce0, CI, cl.size());
+	x.resize(G.rows());
+	ws.lower = cl;
+	ws.upper = cu;
+	return solve_quadprog_rows(ws, G, g0, CE, ce0, CI, x);
+}
+
 
 
 }
+
+#endif // _EIGENQPSTATIC
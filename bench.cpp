@@ -0,0 +1,187 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+namespace btime = boost::posix_time;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <Eigen/Eigen>
+#include "EigenQP.h"
+
+using namespace Eigen;
+using namespace std;
+
+// Batch of long-only portfolio problems sharing one covariance matrix:
+//   min 0.5 x^T G x - mu^T x   s.t.  sum(x) = 1, x >= 0
+void bench_batch()
+{
+	int n = 30, // Assets
+		p = 1, // Budget constraint
+		m = n, // Long only
+		N = 20000; // Accounts
+	
+	MatrixXd F = MatrixXd::Random(n, n);
+	MatrixXd G = F * F.transpose() / n + 0.01 * MatrixXd::Identity(n, n);
+	MatrixXd CE = MatrixXd::Ones(n, p), ce0 = -MatrixXd::Ones(p, N);
+	MatrixXd CI = MatrixXd::Identity(n, m), ci0 = MatrixXd::Zero(m, N);
+	MatrixXd g0 = -0.1 * MatrixXd::Random(n, N);
+	MatrixXd x;
+	VectorXd f;
+	VectorXi status;
+	
+	int max_threads = 1;
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+	cout << "Batch of " << N << " problems (n = " << n << ", p = " << p << ", m = " << m << ")\n";
+	double base = 0;
+	for (int threads = 1; ; threads = min(2 * threads, max_threads))
+	{
+		btime::ptime tic = btime::microsec_clock::local_time();
+		QP::solve_quadprog_batch(G, g0, CE, ce0, CI, ci0, x, f, status, threads);
+		btime::time_duration toc = btime::microsec_clock::local_time() - tic;
+		double ms = toc.total_microseconds() / 1000.;
+		if (threads == 1)
+			base = ms;
+		cout << setw(4) << threads << " threads: " << setw(10) << ms << " ms"
+			<< "  speedup " << base / ms
+			<< "  failed " << (status.array() != QP::SOLVED).count() << "\n";
+		if (threads == max_threads)
+			break;
+	}
+}
+
+// Cost of one active-set iteration across problem sizes: G is factorized once
+// outside of the timing, and the inequalities are random half-spaces through
+// a neighbourhood of the origin, so that about half of them end up active
+void bench_iterations()
+{
+	const int sizes[] = { 2, 10, 50, 200, 1000, 2000 };
+	cout << "Time per iteration of the dynamic solver\n";
+	for (int t = 0; t < 6; ++t)
+	{
+		int n = sizes[t], m = n, N = max(1, 2000 / n);
+		MatrixXd F = MatrixXd::Random(n, n);
+		MatrixXd G = F * F.transpose() / n + MatrixXd::Identity(n, n);
+		MatrixXd CE(n, 0), CI = MatrixXd::Random(n, m);
+		VectorXd ce0(0), ci0 = VectorXd::Constant(m, 1.0), x;
+		QP::Solver solver(n, 0, m);
+		solver.factorize(G);
+		long iterations = 0;
+		btime::time_duration elapsed;
+		for (int k = 0; k < N; ++k)
+		{
+			VectorXd g0 = 10.0 * VectorXd::Random(n);
+			btime::ptime tic = btime::microsec_clock::local_time();
+			solver.solve_factored(g0, CE, ce0, CI, ci0, x);
+			elapsed += btime::microsec_clock::local_time() - tic;
+			iterations += solver.iterations();
+		}
+		cout << "  n = " << setw(5) << n << "  " << setw(10) << elapsed.total_microseconds() / double(iterations)
+			<< " us per iteration (" << iterations / N << " iterations per solve)\n";
+	}
+}
+
+// Preprocessing of a large dense Hessian: the Cholesky factor L of G and
+// J = L^-T, by the unblocked loops previously used in Solver::factorize()
+// and by Solver::factorize() itself
+void factorize_unblocked(MatrixXd& L, MatrixXd& J)
+{
+	int n = L.rows();
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = i; j < n; j++)
+		{
+			double sum = L(i, j);
+			for (int k = i - 1; k >= 0; k--)
+				sum -= L(i, k) * L(j, k);
+			if (i == j)
+				L(i, i) = sqrt(sum);
+			else
+				L(j, i) = sum / L(i, i);
+		}
+		for (int k = i + 1; k < n; k++)
+			L(i, k) = L(k, i);
+	}
+	VectorXd z(n);
+	for (int i = 0; i < n; i++)
+	{
+		for (int r = 0; r < n; r++)
+		{
+			z(r) = (r == i);
+			for (int j = 0; j < r; j++)
+				z(r) -= L(r, j) * z(j);
+			z(r) /= L(r, r);
+		}
+		J.row(i) = z.transpose();
+	}
+}
+
+void bench_factorize()
+{
+	const int sizes[] = { 100, 300, 1000, 2000 };
+	cout << "Factorization of G (Cholesky factor and its inverse)\n";
+	for (int t = 0; t < 4; ++t)
+	{
+		int n = sizes[t];
+		MatrixXd F = MatrixXd::Random(n, n);
+		MatrixXd G = F * F.transpose() / n + 0.01 * MatrixXd::Identity(n, n);
+		MatrixXd L = G, J(n, n);
+		btime::ptime tic = btime::microsec_clock::local_time();
+		factorize_unblocked(L, J);
+		double unblocked = (btime::microsec_clock::local_time() - tic).total_microseconds() / 1000.;
+		
+		QP::Solver solver(n, 0, 0);
+		tic = btime::microsec_clock::local_time();
+		solver.factorize(G);
+		double blocked = (btime::microsec_clock::local_time() - tic).total_microseconds() / 1000.;
+		cout << "  n = " << setw(5) << n << "  unblocked: " << setw(10) << unblocked << " ms"
+			<< "  blocked: " << setw(10) << blocked << " ms"
+			<< "  speedup " << unblocked / blocked << "\n";
+	}
+}
+
+// The same kind of problems as bench_iterations(), factorized and solved in
+// double and in mixed precision (float iterations, refined in double)
+void bench_mixed()
+{
+	const int sizes[] = { 100, 300, 1000 };
+	cout << "Double and mixed precision solves\n";
+	for (int t = 0; t < 3; ++t)
+	{
+		int n = sizes[t], m = n;
+		MatrixXd F = MatrixXd::Random(n, n);
+		MatrixXd G = F * F.transpose() / n + MatrixXd::Identity(n, n);
+		MatrixXd CE(n, 0), CI = MatrixXd::Random(n, m);
+		VectorXd ce0(0), ci0 = VectorXd::Constant(m, 1.0), g0 = 10.0 * VectorXd::Random(n), x, x_mixed;
+		QP::Solver solver;
+		QP::MixedSolver mixed;
+		btime::ptime tic = btime::microsec_clock::local_time();
+		solver.solve(G, g0, CE, ce0, CI, ci0, x);
+		double full = (btime::microsec_clock::local_time() - tic).total_microseconds() / 1000.;
+		tic = btime::microsec_clock::local_time();
+		mixed.solve(G, g0, CE, ce0, CI, ci0, x_mixed);
+		double ms = (btime::microsec_clock::local_time() - tic).total_microseconds() / 1000.;
+		cout << "  n = " << setw(5) << n << "  double: " << setw(10) << full << " ms"
+			<< "  mixed: " << setw(10) << ms << " ms"
+			<< "  speedup " << full / ms << "  refinement steps " << mixed.refinement_steps()
+			<< (mixed.fell_back() ? " (fell back)" : "")
+			<< "  |dx| " << scientific << (x - x_mixed).norm() / x.norm() << fixed << "\n";
+	}
+}
+
+int main()
+{
+	cout << fixed << setprecision(3);
+	bench_batch();
+	bench_factorize();
+	bench_iterations();
+	bench_mixed();
+	return 0;
+}
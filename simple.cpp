@@ -26,33 +26,36 @@ int main()
 	cout << setprecision(10);
 	int count = 10000;
 	
-	// Add n rows to constraints for x >= 0
-	MatrixXd H(n, n), A(m + n, n), Ae(p, n);
-	VectorXd x(n), f(n), b(m + n);
+	// x >= 0 is given as bounds, rather than as n more rows of A
+	MatrixXd H(n, n);
+	// A x <= b in row form: row-major A and Ae are used in place, and the
+	// sense of the rows saves negating A into -A x + b >= 0
+	Matrix<double, Dynamic, Dynamic, RowMajor> A(m, n), Ae(p, n);
+	VectorXd x(n), f(n), b(m);
 	VectorXd be(p);
+	VectorXd lb = VectorXd::Zero(n),
+		ub = VectorXd::Constant(n, numeric_limits<double>::infinity());
 	
 	H = MatrixXd::Identity(n, n);
 	f = VectorXd::Zero(n);
 	A <<
-		-MatrixXd::Identity(n, n),
 		-1, -2,
 		-1, 1,
 		1, 0;
 	b <<
-		VectorXd::Zero(n),
 		-2, 1, 3; //, ;
 	
-	// For their library
-	A.transposeInPlace();
-	Ae.transposeInPlace();
-	
 	btime::ptime tic = btime::microsec_clock::local_time();
 	//boost::timer timer;
 	// Does this modify H?
 	double objVal;
+	// Size the workspace once, outside of the loop (the bounds are n more
+	// inequality rows)
+	QP::Solver solver(n, p, m + n);
+	solver.set_bounds(lb, ub);
 	for (int i = 0; i < count; ++i)
 	{
-		objVal = QP::solve_quadprog(H, f, -Ae, be, -A, b, x);
+		objVal = solver.solve_rows(H, f, Ae, be, A, b, QP::LESS_EQUAL, x);
 	}
 	btime::time_duration toc = btime::microsec_clock::local_time() - tic;
 	cout << "Elapsed time: " << setprecision(8) << toc.total_milliseconds() << " ms\n";
@@ -40,7 +40,7 @@ int main()
 	be.setZero(p);
 	
 	H = EMATd(n, n)::Identity();
-	//f = EVECd(::Zero(n);
+	f.setZero();
 	A <<
 		-EMATd(n, n)::Identity(),
 		-1, -2,
@@ -62,9 +62,11 @@ int main()
 	//boost::timer timer;
 	// Does this modify H?
 	double objVal;
+	// One workspace per thread; fixed-size, so no heap allocation
+	QP::Workspace<n, p, m + n> ws;
 	for (int i = 0; i < count; ++i)
 	{
-		objVal = QP::solve_quadprog<n, p, m + n>(H, f, -Ae.transpose(), be, -A.transpose(), b, x);
+		objVal = QP::solve_quadprog<n, p, m + n>(ws, H, f, -Ae.transpose(), be, -A.transpose(), b, x);
 	}
 	btime::time_duration toc = btime::microsec_clock::local_time() - tic;
 	cout << "Elapsed time: " << setprecision(8) << toc.total_milliseconds() << " ms\n";
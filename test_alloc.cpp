@@ -0,0 +1,116 @@
+/*
+ Checks that repeated solves of the same dimensions do not touch the heap,
+ once the solver has been sized by a first solve. malloc is counted (it is
+ glibc's, called through __libc_malloc), which also catches operator new,
+ and the solver is compiled into this file with EIGEN_RUNTIME_NO_MALLOC, so
+ that Eigen asserts on any allocation made while it is not allowed.
+ Returns nonzero, and names the solve, if one allocated.
+ */
+#define EIGEN_RUNTIME_NO_MALLOC
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+#include "EigenQP.cpp"
+
+extern "C" void* __libc_malloc(size_t size);
+
+static long allocations = 0;
+static bool counting = false;
+
+extern "C" void* malloc(size_t size)
+{
+	if (counting)
+		++allocations;
+	return __libc_malloc(size);
+}
+
+using namespace Eigen;
+using namespace std;
+
+static int failures = 0;
+
+/* runs f once to size the workspace, then count times with the heap watched */
+template<typename F>
+static void check(const char* name, F f, int count = 10)
+{
+	f();
+	allocations = 0;
+	counting = true;
+	internal::set_is_malloc_allowed(false);
+	for (int i = 0; i < count; ++i)
+		f();
+	internal::set_is_malloc_allowed(true);
+	counting = false;
+	cout << name << ": " << allocations << " allocations\n";
+	if (allocations != 0)
+		++failures;
+}
+
+int main()
+{
+	int n = 8, p = 2, m = 12;
+	double inf = numeric_limits<double>::infinity();
+
+	srand(1);
+	MatrixXd M = MatrixXd::Random(n, n);
+	MatrixXd G = M * M.transpose() + MatrixXd::Identity(n, n);
+	VectorXd g0 = VectorXd::Random(n);
+	MatrixXd CE = MatrixXd::Random(n, p), CI = MatrixXd::Random(n, m);
+	VectorXd ce0 = VectorXd::Random(p), ci0 = -VectorXd::Ones(m);
+	VectorXd cl = -VectorXd::Ones(m), cu = VectorXd::Ones(m);
+	cu(0) = inf;
+	VectorXd lb = VectorXd::Constant(n, -0.5), ub = VectorXd::Constant(n, 0.5);
+	MatrixXd CI0(n, 0);
+	VectorXd ci00(0);
+	Matrix<double, Dynamic, Dynamic, RowMajor> Aeq = CE.transpose(), Ain = CI.transpose();
+	VectorXd x(n);
+	VectorXi active, none(0);
+	VectorXd u;
+
+	QP::Solver solver(n, p, m);
+	check("solve", [&]() { solver.solve(G, g0, CE, ce0, CI, ci0, x); });
+	solver.get_active_set(active, u);
+	check("warm start", [&]() { solver.solve(G, g0, CE, ce0, CI, ci0, x, active); });
+	check("ranged", [&]() { solver.solve_ranged(G, g0, CE, ce0, CI, cl, cu, x); });
+	check("rows", [&]() { solver.solve_rows(G, g0, Aeq, ce0, Ain, ci0, QP::LESS_EQUAL, x); });
+	/* an empty warm start: the direct solve, kept or followed by the 
+	   iterations when it violates a row */
+	VectorXd ci0_loose = VectorXd::Constant(m, 100.0);
+	check("empty warm start", [&]() { solver.solve(G, g0, CE, ce0, CI, ci0_loose, x, none); });
+	check("empty warm start, violated", [&]() { solver.solve(G, g0, CE, ce0, CI, ci0, x, none); });
+	solver.factorize(G);
+	check("factored", [&]() { solver.solve_factored(g0, CE, ce0, CI, ci0, x); });
+
+	/* the reduced problem keeps a workspace of its own */
+	check("null space", [&]() {
+		solver.solve(G, g0, CE, ce0, CI, ci0, x);
+		solver.solve_nullspace(G, g0, CE, ce0, CI, ci0, x);
+	});
+
+	QP::Solver bounded(n, p, m + n);
+	bounded.set_bounds(lb, ub);
+	check("bounds", [&]() { bounded.solve(G, g0, CE, ce0, CI, ci0, x); });
+	check("null space, bounds", [&]() { bounded.solve_nullspace(G, g0, CE, ce0, CI, ci0, x); });
+
+	QP::Solver equality(n, p, 0);
+	check("equality only", [&]() { equality.solve(G, g0, CE, ce0, CI0, ci00, x); });
+
+	QP::Problem problem(G, g0, CE, ce0, CI, ci0);
+	problem.solve(x);
+	VectorXd g1 = g0;
+	check("problem", [&]() {
+		g1(0) = -g1(0);
+		problem.set_g0(g1);
+		problem.solve(x);
+	});
+
+	if (failures > 0)
+	{
+		cout << failures << " solves allocated\n";
+		return 1;
+	}
+	cout << "no allocation\n";
+	return 0;
+}
@@ -0,0 +1,331 @@
+/*
+ Checks the answers of the solves that reuse state from a previous one:
+ each re-solve of a QP::Problem, hot or warm started, after a setter or
+ add_constraints(), is compared with a cold solve of the same problem by
+ a new QP::Solver, for the objective, x, the active set and its 
+ multipliers.
+ Then single cases with a known answer. Returns nonzero, and names the
+ case, if one differed.
+ */
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+#include <Eigen/Eigen>
+#include "EigenQP.h"
+#include "EigenQPStatic.hpp"
+
+using namespace Eigen;
+using namespace std;
+
+static int failures = 0;
+static const double inf = numeric_limits<double>::infinity();
+
+/* a random problem, strictly convex, feasible with x = 0 when ci0 > 0 */
+struct Data
+{
+	MatrixXd G, CE, CI;
+	VectorXd g0, ce0, ci0, lb, ub;
+
+	Data(int n, int p, int m)
+	{
+		MatrixXd M = MatrixXd::Random(n, n);
+		G = M * M.transpose() + 0.1 * MatrixXd::Identity(n, n);
+		g0 = 5.0 * VectorXd::Random(n);
+		CE = MatrixXd::Random(n, p);
+		ce0 = 0.1 * VectorXd::Random(p);
+		CI = MatrixXd::Random(n, m);
+		ci0 = VectorXd::Random(m).array() + 1.0;
+	}
+};
+
+/* the active set sorted, with the multipliers along */
+static void sorted_active_set(VectorXi& active, VectorXd& u)
+{
+	vector<pair<int, double> > a(active.size());
+	for (int i = 0; i < active.size(); ++i)
+		a[i] = make_pair(active(i), u(i));
+	sort(a.begin(), a.end());
+	for (int i = 0; i < active.size(); ++i)
+	{
+		active(i) = a[i].first;
+		u(i) = a[i].second;
+	}
+}
+
+/* compares the solve of problem, which left f and x, with a cold solve of d */
+static bool same(const QP::Problem& problem, double f, const VectorXd& x, const Data& d)
+{
+	QP::Solver cold;
+	if (d.lb.size() > 0)
+		cold.set_bounds(d.lb, d.ub);
+	VectorXd x_cold;
+	double f_cold = cold.solve(d.G, d.g0, d.CE, d.ce0, d.CI, d.ci0, x_cold);
+	if (f == inf || f_cold == inf)
+		return f == f_cold;
+	VectorXi active, active_cold;
+	VectorXd u, u_cold;
+	problem.get_active_set(active, u);
+	cold.get_active_set(active_cold, u_cold);
+	sorted_active_set(active, u);
+	sorted_active_set(active_cold, u_cold);
+	return fabs(f - f_cold) <= 1e-8 * (1.0 + fabs(f_cold))
+		&& (x - x_cold).norm() <= 1e-7 * (1.0 + x_cold.norm())
+		&& active == active_cold
+		&& (u - u_cold).norm() <= 1e-6 * (1.0 + u_cold.norm());
+}
+
+/* a single solve with a known objective */
+static void known(const char* name, double f, double expected)
+{
+	bool agree = f == expected || fabs(f - expected) <= 1e-10 * (1.0 + fabs(expected));
+	cout << name << ": " << f << (agree ? "" : ", wrong") << "\n";
+	if (!agree)
+		++failures;
+}
+
+/*
+ Runs change on trials random problems: the Problem is solved, changed by
+ change(problem, d), which applies the same change to d, and solved again
+ */
+template<typename F>
+static void check(const char* name, int p, int m, bool bounds, F change, int trials = 200)
+{
+	int wrong = 0, solved = 0;
+	for (int t = 0; t < trials; ++t)
+	{
+		int n = 4 + rand() % 6;
+		Data d(n, p, m);
+		if (bounds)
+		{
+			d.lb = -VectorXd::Random(n).cwiseAbs() - VectorXd::Constant(n, 0.2);
+			d.ub = VectorXd::Random(n).cwiseAbs() + VectorXd::Constant(n, 0.2);
+		}
+		QP::Problem problem(d.G, d.g0, d.CE, d.ce0, d.CI, d.ci0);
+		if (bounds)
+			problem.set_bounds(d.lb, d.ub);
+		VectorXd x;
+		double f = problem.solve(x);
+		if (!same(problem, f, x, d))
+		{
+			++wrong;
+			continue;
+		}
+		change(problem, d);
+		f = problem.solve(x);
+		if (f != inf)
+			++solved;
+		if (!same(problem, f, x, d))
+			++wrong;
+	}
+	cout << name << ": " << wrong << " of " << trials << " differ (" << solved << " feasible)\n";
+	if (wrong != 0)
+		++failures;
+}
+
+int main()
+{
+	srand(1);
+
+	check("set_g0", 2, 10, false, [](QP::Problem& problem, Data& d) {
+		d.g0 = 5.0 * VectorXd::Random(d.g0.size());
+		problem.set_g0(d.g0);
+	});
+	check("set_ci0", 1, 10, false, [](QP::Problem& problem, Data& d) {
+		d.ci0 = VectorXd::Random(d.ci0.size());
+		problem.set_ci0(d.ci0);
+	});
+	check("set_ce0", 2, 10, false, [](QP::Problem& problem, Data& d) {
+		d.ce0 = VectorXd::Random(d.ce0.size());
+		problem.set_ce0(d.ce0);
+	});
+	check("set_ci", 1, 10, false, [](QP::Problem& problem, Data& d) {
+		/* a column that may or may not be active */
+		int i = rand() % d.CI.cols();
+		d.CI.col(i).setRandom();
+		problem.set_ci(i, d.CI.col(i));
+	});
+	check("set_bounds", 1, 6, true, [](QP::Problem& problem, Data& d) {
+		d.lb = 0.5 * d.lb;
+		d.ub = 0.5 * d.ub;
+		problem.set_bounds(d.lb, d.ub);
+	});
+	/* the new rows are numbered before the bounds, which are shifted */
+	check("add_constraints", 1, 8, true, [](QP::Problem& problem, Data& d) {
+		int n = d.CI.rows(), m = d.CI.cols(), k = 3;
+		MatrixXd cuts = MatrixXd::Random(n, k);
+		VectorXd cuts0 = 0.2 * VectorXd::Random(k);
+		d.CI.conservativeResize(NoChange, m + k);
+		d.CI.rightCols(k) = cuts;
+		d.ci0.conservativeResize(m + k);
+		d.ci0.tail(k) = cuts0;
+		problem.add_constraints(cuts, cuts0);
+	});
+	check("add_constraints, m = 0", 2, 0, false, [](QP::Problem& problem, Data& d) {
+		int n = d.CI.rows(), k = 2;
+		d.CI = MatrixXd::Random(n, k);
+		d.ci0 = 0.2 * VectorXd::Random(k);
+		problem.add_constraints(d.CI, d.ci0);
+	});
+	/* the rows x(0) >= a and x(0) <= b, infeasible for a > b, then
+	   feasible again: the solve after the infeasible one resumes from it */
+	check("resume after infeasible", 1, 8, false, [](QP::Problem& problem, Data& d) {
+		int n = d.CI.rows(), m = d.CI.cols();
+		VectorXd e = VectorXd::Zero(n);
+		e(0) = 1.0;
+		d.CI.col(m - 2) = e;
+		d.CI.col(m - 1) = -e;
+		problem.set_CI(d.CI);
+		d.ci0(m - 2) = -2.0;
+		d.ci0(m - 1) = 1.0;
+		problem.set_ci0(d.ci0);
+		VectorXd x;
+		if (problem.solve(x) != inf || !same(problem, inf, x, d))
+		{
+			cout << "resume after infeasible: the infeasible solve differs\n";
+			++failures;
+		}
+		d.ci0(m - 2) = 0.5;
+		d.ci0(m - 1) = 1.0;
+		problem.set_ci0(d.ci0);
+	});
+
+	/* a shared G that is not positive definite fails every problem of a
+	   batch, as one G per problem would */
+	{
+		int n = 3, N = 4;
+		MatrixXd G = -MatrixXd::Identity(n, n), CE(n, 0), CI(n, 0), x;
+		MatrixXd g0 = MatrixXd::Random(n, N), ce0(0, N), ci0(0, N);
+		VectorXd f;
+		VectorXi status;
+		bool failed;
+		try
+		{
+			QP::solve_quadprog_batch(G, g0, CE, ce0, CI, ci0, x, f, status);
+			failed = (status.array() == QP::FAILED).all();
+		}
+		catch (std::exception&)
+		{
+			failed = false;
+		}
+		cout << "batch, shared G not positive definite: " << (failed ? "all failed" : "wrong") << "\n";
+		if (!failed)
+			++failures;
+	}
+
+	/* a row with lower > upper cannot be made active at one end without
+	   violating the other one */
+	{
+		int n = 2;
+		MatrixXd G = MatrixXd::Identity(n, n), CE(n, 0), CI(n, 0), CI1(n, 1);
+		VectorXd g0 = VectorXd::Constant(n, -5.0), ce0(0), ci0(0), x;
+		VectorXd lb(n), ub(n), cl(1), cu(1);
+		lb << 1.0, -10.0;
+		ub << 0.0, 10.0;
+		QP::Solver solver;
+		solver.set_bounds(lb, ub);
+		known("bounds with lb > ub", solver.solve(G, g0, CE, ce0, CI, ci0, x), inf);
+		CI1 << 1.0, 0.0;
+		cl << 1.0;
+		cu << 0.0;
+		QP::Solver ranged;
+		known("ranged with cl > cu", ranged.solve_ranged(G, g0, CE, ce0, CI1, cl, cu, x), inf);
+		Matrix2d Gs = Matrix2d::Identity();
+		Vector2d g0s = g0, xs;
+		Matrix<double, 2, 0> CEs;
+		Matrix<double, 0, 1> ce0s;
+		Matrix<double, 2, 1> CIs = CI1;
+		Matrix<double, 1, 1> cls = cl, cus = cu;
+		known("static, ranged with cl > cu",
+			QP::solve_quadprog<2, 0, 1>(Gs, g0s, CEs, ce0s, CIs, cls, cus, xs), inf);
+	}
+
+	/* more equalities than variables, with no inequality: the direct solve
+	   reports them dependent, as the iterations do */
+	{
+		MatrixXd G = MatrixXd::Identity(1, 1), CE = MatrixXd::Ones(1, 2), CI(1, 0);
+		VectorXd g0 = VectorXd::Ones(1), ce0 = -VectorXd::Ones(2), ci0(0), x;
+		bool thrown = false;
+		try
+		{
+			QP::Solver solver;
+			solver.solve(G, g0, CE, ce0, CI, ci0, x);
+		}
+		catch (std::runtime_error&)
+		{
+			thrown = true;
+		}
+		cout << "p > n, m = 0: " << (thrown ? "dependent" : "wrong") << "\n";
+		if (!thrown)
+			++failures;
+	}
+
+	/* equalities only: the float solve takes the direct path, which the
+	   refinement in double keeps, with no fallback to the double solver */
+	{
+		int n = 8, p = 3, wrong = 0, fell_back = 0;
+		for (int t = 0; t < 50; ++t)
+		{
+			Data d(n, p, 0);
+			QP::Solver solver;
+			QP::MixedSolver mixed;
+			VectorXd x, x_mixed;
+			double f = solver.solve(d.G, d.g0, d.CE, d.ce0, d.CI, d.ci0, x);
+			double f_mixed = mixed.solve(d.G, d.g0, d.CE, d.ce0, d.CI, d.ci0, x_mixed);
+			if (mixed.fell_back())
+				++fell_back;
+			if (fabs(f - f_mixed) > 1e-8 * (1.0 + fabs(f)) || (x - x_mixed).norm() > 1e-7 * (1.0 + x.norm()))
+				++wrong;
+		}
+		cout << "mixed, equalities only: " << wrong << " of 50 differ, " << fell_back << " fell back\n";
+		if (wrong != 0 || fell_back != 0)
+			++failures;
+	}
+
+	/* least squares, factorized by QR, against solve() on G = A^T A */
+	{
+		int wrong = 0;
+		for (int t = 0; t < 50; ++t)
+		{
+			int n = 4 + rand() % 6, rows = n + rand() % 5;
+			Data d(n, 1, 6);
+			MatrixXd A = MatrixXd::Random(rows, n);
+			VectorXd b = VectorXd::Random(rows), x, x_ls;
+			QP::Solver solver, ls;
+			double f = solver.solve(A.transpose() * A, -A.transpose() * b, d.CE, d.ce0, d.CI, d.ci0, x);
+			double f_ls = ls.solve_least_squares(A, b, d.CE, d.ce0, d.CI, d.ci0, x_ls);
+			f += 0.5 * b.squaredNorm();
+			if (fabs(f - f_ls) > 1e-8 * (1.0 + fabs(f)) || (x - x_ls).norm() > 1e-7 * (1.0 + x.norm()))
+				++wrong;
+		}
+		cout << "least squares: " << wrong << " of 50 differ\n";
+		if (wrong != 0)
+			++failures;
+	}
+
+	/* a static Workspace with no inequality (m = 0): min 0.5 |x|^2 - x0 - x1
+	   subject to x0 + x1 = 1, at x = (0.5, 0.5) */
+	{
+		Matrix2d G = Matrix2d::Identity();
+		Vector2d g0(-1.0, -1.0), CE(1.0, 1.0), x;
+		Matrix<double, 1, 1> ce0;
+		ce0 << -1.0;
+		Matrix<double, 2, 0> CI;
+		Matrix<double, 0, 1> ci0;
+		QP::Workspace<2, 1, 0> ws;
+		known("static, m = 0", QP::solve_quadprog(ws, G, g0, CE, ce0, CI, ci0, x), -0.75);
+	}
+
+	if (failures > 0)
+	{
+		cout << failures << " cases differ from the expected answer\n";
+		return 1;
+	}
+	cout << "all cases agree\n";
+	return 0;
+}